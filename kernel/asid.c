@@ -0,0 +1,263 @@
+//
+// Address-space IDs.
+//
+// Each process's page tables, user and kernel (see kvmcreate()),
+// are tagged with an ASID in satp, and the global kernel page
+// table uses ASID 0, so switching between them (on every trap
+// and return to user space) and between processes needs no TLB
+// flush. The two page tables of a process can share an ASID
+// because they map the same user memory, and each maps nothing
+// at addresses where the other has accessible mappings. When
+// a process's mappings change, only its own ASID is flushed.
+//
+// ASIDs are handed out in order and never freed. When they run
+// out, the generation number is bumped and numbering starts
+// again; each hart flushes its whole TLB before it next enters
+// user space, and each process is given an ASID of the new
+// generation the next time the scheduler switches to it.
+//
+// A process may have run on other harts, whose TLBs may still
+// hold its old translations. Rather than interrupting them,
+// p->tlbstale records which harts must flush p's ASID before
+// running p again. This relies on a process's page table being
+// changed only by the process itself, or before it first runs.
+//
+// The threads of a process (see clone()) share its page table,
+// and so its ASID and tlbstale, both kept in the main thread.
+// When one changes the mappings while others are running on
+// other harts, those harts cannot wait until they next switch:
+// asidflush() interrupts them, and waits until each has
+// flushed (a TLB shootdown).
+//
+// Build with make NOASID=1 to flush the whole TLB on every
+// switch of page table instead, for comparison.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define ALLHARTS ((1L << NCPU) - 1)
+
+struct {
+  struct spinlock lock;
+  int bits;         // ASID bits the hardware implements
+  int max;          // largest ASID
+  int next;         // next ASID to hand out
+  uint64 gen;       // generation; starts at 1
+  uint64 nalloc;    // ASIDs handed out
+  uint64 nflush;    // single-ASID flushes
+  uint64 nfull;     // whole-TLB flushes
+  uint64 nshoot;    // harts interrupted to flush
+} asids;
+
+// Find out how many ASID bits satp implements, by writing
+// ones to the field and reading back what stuck.
+void
+asidinit(void)
+{
+  uint64 satp, x;
+
+  initlock(&asids.lock, "asid");
+  satp = r_satp();
+  w_satp(satp | (SATP_ASID_MASK << SATP_ASID_SHIFT));
+  x = (r_satp() >> SATP_ASID_SHIFT) & SATP_ASID_MASK;
+  w_satp(satp);
+  sfence_vma();
+
+  for(asids.bits = 0; x & 1; x >>= 1)
+    asids.bits++;
+#ifndef NOASID
+  if(asids.bits == 0)
+    panic("asidinit: no ASIDs; build with NOASID=1");
+#endif
+  asids.max = (1 << asids.bits) - 1;
+  asids.next = 1;
+  asids.gen = 1;
+}
+
+// Give main thread m a fresh ASID of the current generation.
+// Caller holds asids.lock.
+static void
+newasid(struct proc *m)
+{
+  if(asids.next > asids.max){
+    asids.gen++;
+    asids.next = 1;
+  }
+  m->asid = asids.next++;
+  m->asidgen = asids.gen;
+  asids.nalloc++;
+
+  // the first use on each hart also makes sure the
+  // new page table's contents are seen.
+  m->tlbstale = ALLHARTS;
+}
+
+// Give p, a main thread, a fresh ASID of the current
+// generation. Called when its page tables are created.
+void
+asidalloc(struct proc *p)
+{
+#ifdef NOASID
+  p->asid = 0;
+  return;
+#endif
+  acquire(&asids.lock);
+  newasid(p);
+  release(&asids.lock);
+}
+
+// Return the satp value for pagetable, one of p's, first
+// flushing whatever this hart's TLB may hold that p must not
+// see. Called by the scheduler before switching to p, with
+// interrupts off, and by exec().
+uint64
+asidsatp(struct proc *p, pagetable_t pagetable)
+{
+#ifdef NOASID
+  // kvmswitch(), userret and uservec each flush everything.
+  asids.nfull += 3;
+  return MAKE_SATP(pagetable);
+#else
+  struct proc *m = p->main;
+  struct cpu *c = mycpu();
+  uint64 bit = 1L << cpuid();
+  uint64 gen;
+
+  // a racy read is fine: a hart that misses a new generation
+  // keeps using old-generation ASIDs, which no process of the
+  // new generation can run with on this hart until it flushes.
+  gen = asids.gen;
+  if(m->asidgen != gen){
+    acquire(&asids.lock);
+    // a thread of m on another hart may have got there first.
+    if(m->asidgen != asids.gen)
+      newasid(m);
+    release(&asids.lock);
+    gen = m->asidgen;
+  }
+  // p keeps this one while it runs, even if another thread
+  // of m moves m to a new generation meanwhile.
+  p->asid = m->asid;
+  if(c->asidgen != gen){
+    sfence_vma();
+    c->asidgen = gen;
+    __sync_fetch_and_and(&m->tlbstale, ~bit);
+    asids.nfull++;
+  } else if(m->tlbstale & bit){
+    sfence_vma_asid(p->asid);
+    __sync_fetch_and_and(&m->tlbstale, ~bit);
+    asids.nflush++;
+  }
+  return MAKE_SATP_ASID(pagetable, p->asid);
+#endif
+}
+
+// Flush this hart's TLB of the running process's entries,
+// if a hart in shootdown() has asked it to. Called by
+// devintr() for a software interrupt, with interrupts off.
+void
+asidintr(void)
+{
+  struct proc *p = mycpu()->proc;
+  uint64 bit = 1L << cpuid();
+
+  if(p == 0 || (p->main->tlbstale & bit) == 0)
+    return;
+#ifdef NOASID
+  sfence_vma();
+#else
+  sfence_vma_asid(p->asid);
+#endif
+  __sync_fetch_and_and(&p->main->tlbstale, ~bit);
+  asids.nflush++;
+}
+
+// Other harts may be running threads of m, caching what
+// asidflush() just flushed here. Interrupt them, and wait
+// until each has flushed or gone on to another process.
+// Interrupts are off.
+static void
+shootdown(struct proc *m)
+{
+  struct proc *q;
+  int i, me;
+
+  me = cpuid();
+  for(i = 0; i < NCPU; i++){
+    if(i != me && (q = cpus[i].proc) != 0 && q->main == m){
+      *(uint32*)KCLINT_MSIP(i) = 1;
+      asids.nshoot++;
+    }
+  }
+  for(i = 0; i < NCPU; i++){
+    while(i != me && (m->tlbstale & (1L << i)) &&
+          (q = cpus[i].proc) != 0 && q->main == m){
+      // that hart may be waiting the same way for this one.
+      asidintr();
+    }
+  }
+}
+
+// p's mappings were removed or changed, not just added:
+// flush p's ASID here, on harts running p's other threads
+// now, and on other harts before p next runs on them.
+// Called by p itself.
+void
+asidflush(struct proc *p)
+{
+  struct proc *m = p->main;
+
+  push_off();
+#ifdef NOASID
+  sfence_vma();
+#else
+  sfence_vma_asid(p->asid);
+#endif
+  // the atomic or is a fence, so the reads of cpus[].proc in
+  // shootdown() come after it; the scheduler sets c->proc
+  // before it reads tlbstale in asidsatp().
+  __sync_fetch_and_or(&m->tlbstale, ALLHARTS & ~(1L << cpuid()));
+  asids.nflush++;
+  // only p's threads could clone another meanwhile.
+  if(m->nthread > 1)
+    shootdown(m);
+  pop_off();
+}
+
+// p's mappings were changed by another process while p was
+// not running: flush p's ASID on every hart before p next
+// runs there. Caller holds p->lock.
+void
+asidstale(struct proc *p)
+{
+#ifndef NOASID
+  p->main->tlbstale = ALLHARTS;
+#endif
+}
+
+// A fault on va was resolved: drop any translation of it this
+// hart cached before the page was mapped or made writable.
+void
+asidflushva(struct proc *p, uint64 va)
+{
+#ifdef NOASID
+  sfence_vma();
+#else
+  sfence_vma_page(PGROUNDDOWN(va), p->asid);
+#endif
+}
+
+// Report ASID use and flush counts for the statistics device.
+int
+asidstats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "asid: bits %d gen %l alloc %l flush %l fullflush %l shootdown %l\n",
+                  asids.bits, asids.gen, asids.nalloc, asids.nflush, asids.nfull,
+                  asids.nshoot);
+}
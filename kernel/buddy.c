@@ -0,0 +1,210 @@
+// Buddy allocator for physically contiguous blocks of
+// 2^order pages, 0 <= order <= MAXORDER.
+//
+// Free blocks of each order sit on a doubly-linked list
+// threaded through the blocks themselves. A block of order k
+// starting at pa has a buddy at pa ^ (PGSIZE << k), relative
+// to KERNBASE; when both are free they are merged into one
+// block of order k+1. pginfo[] records, for the first page of
+// each free block, that it is free and its order, so that
+// buddy_free() can tell whether a buddy may be merged.
+//
+// kalloc.c caches single pages per CPU on top of this;
+// other code should use kalloc()/kalloc_pages().
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NPAGE ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PGINDEX(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+#define BLKSIZE(order) ((uint64)PGSIZE << (order))
+
+#define BFREE 0x80  // pginfo[]: first page of a free block
+
+struct block {
+  struct block *next;
+  struct block *prev;
+};
+
+struct {
+  struct spinlock lock;
+  struct block free[MAXORDER+1];  // list heads, one per order
+  int nfree[MAXORDER+1];          // blocks on each list
+  uint64 nsplit;                  // blocks split in two
+  uint64 nmerge;                  // buddies merged
+  uint64 nfail;                   // allocations that failed
+} buddy;
+
+static uchar pginfo[NPAGE];
+
+static void
+listinit(struct block *head)
+{
+  head->next = head;
+  head->prev = head;
+}
+
+static void
+listremove(struct block *b)
+{
+  b->prev->next = b->next;
+  b->next->prev = b->prev;
+}
+
+static void
+listpush(struct block *head, struct block *b)
+{
+  b->next = head->next;
+  b->prev = head;
+  head->next->prev = b;
+  head->next = b;
+}
+
+void
+buddyinit(void)
+{
+  initlock(&buddy.lock, "buddy");
+  for(int k = 0; k <= MAXORDER; k++)
+    listinit(&buddy.free[k]);
+}
+
+// Allocate a block of 2^order pages, without junk-filling it.
+// Returns 0 if no block of that order or larger is free.
+void *
+buddy_alloc(int order)
+{
+  struct block *b;
+  int k;
+
+  if(order < 0 || order > MAXORDER)
+    panic("buddy_alloc: order");
+
+  acquire(&buddy.lock);
+  for(k = order; k <= MAXORDER; k++)
+    if(buddy.nfree[k] > 0)
+      break;
+  if(k > MAXORDER){
+    buddy.nfail++;
+    release(&buddy.lock);
+    return 0;
+  }
+
+  b = buddy.free[k].next;
+  listremove(b);
+  buddy.nfree[k]--;
+  pginfo[PGINDEX(b)] = 0;
+
+  // split, putting the upper halves back on the free lists.
+  while(k > order){
+    struct block *upper;
+
+    k--;
+    upper = (struct block *)((char*)b + BLKSIZE(k));
+    listpush(&buddy.free[k], upper);
+    buddy.nfree[k]++;
+    pginfo[PGINDEX(upper)] = BFREE | k;
+    buddy.nsplit++;
+  }
+  release(&buddy.lock);
+  return (void*)b;
+}
+
+// Return a block of 2^order pages, merging it with
+// its buddy for as long as the buddy is free too.
+void
+buddy_free(void *pa, int order)
+{
+  uint64 a, bud;
+
+  a = (uint64)pa;
+  if(order < 0 || order > MAXORDER)
+    panic("buddy_free: order");
+  if((a - KERNBASE) % BLKSIZE(order) != 0 || a < KERNBASE ||
+     a + BLKSIZE(order) > PHYSTOP)
+    panic("buddy_free: addr");
+
+  acquire(&buddy.lock);
+  if(pginfo[PGINDEX(a)] & BFREE)
+    panic("buddy_free: double free");
+  while(order < MAXORDER){
+    bud = KERNBASE + ((a - KERNBASE) ^ BLKSIZE(order));
+    if(bud + BLKSIZE(order) > PHYSTOP || pginfo[PGINDEX(bud)] != (BFREE | order))
+      break;
+    listremove((struct block *)bud);
+    buddy.nfree[order]--;
+    pginfo[PGINDEX(bud)] = 0;
+    buddy.nmerge++;
+    if(bud < a)
+      a = bud;
+    order++;
+  }
+  listpush(&buddy.free[order], (struct block *)a);
+  buddy.nfree[order]++;
+  pginfo[PGINDEX(a)] = BFREE | order;
+  release(&buddy.lock);
+}
+
+// Hand the pages in [pa_start, pa_end) to the allocator,
+// in the largest aligned blocks that fit.
+void
+buddy_free_range(void *pa_start, void *pa_end)
+{
+  uint64 a, end;
+  int k;
+
+  a = PGROUNDUP((uint64)pa_start);
+  end = PGROUNDDOWN((uint64)pa_end);
+  while(a < end){
+    for(k = MAXORDER; k > 0; k--)
+      if((a - KERNBASE) % BLKSIZE(k) == 0 && a + BLKSIZE(k) <= end)
+        break;
+    buddy_free((void*)a, k);
+    a += BLKSIZE(k);
+  }
+}
+
+// orders whose fragmentation is reported: 8 KB, 64 KB, 2 MB.
+static int fragorders[] = { 1, 4, 9 };
+
+// Report free blocks per order and how fragmented free
+// memory is for the statistics device. "unusable" is the
+// percentage of free pages that sit in blocks too small
+// to satisfy an allocation of the given order.
+int
+buddystats(char *buf, int sz)
+{
+  int n, k, nfree[MAXORDER+1];
+  uint64 pages, small, pct;
+
+  acquire(&buddy.lock);
+  for(k = 0; k <= MAXORDER; k++)
+    nfree[k] = buddy.nfree[k];
+  release(&buddy.lock);
+
+  pages = 0;
+  for(k = 0; k <= MAXORDER; k++)
+    pages += (uint64)nfree[k] << k;
+
+  n = snprintf(buf, sz, "buddy: free %l pages split %l merge %l fail %l\n",
+               pages, buddy.nsplit, buddy.nmerge, buddy.nfail);
+  n += snprintf(buf+n, sz-n, "buddy: blocks");
+  for(k = 0; k <= MAXORDER; k++)
+    n += snprintf(buf+n, sz-n, " %d", nfree[k]);
+  n += snprintf(buf+n, sz-n, "\n");
+
+  n += snprintf(buf+n, sz-n, "buddy: unusable");
+  for(int i = 0; i < NELEM(fragorders); i++){
+    k = fragorders[i];
+    small = 0;
+    for(int j = 0; j < k; j++)
+      small += (uint64)nfree[j] << j;
+    pct = pages ? (small * 100) / pages : 0;
+    n += snprintf(buf+n, sz-n, " order%d %l%%", k, pct);
+  }
+  n += snprintf(buf+n, sz-n, "\n");
+  return n;
+}
@@ -0,0 +1,226 @@
+//
+// Timer interrupts, without a fixed tick.
+//
+// Nothing programs the CLINT to interrupt at a fixed
+// interval. Instead each hart keeps a timer wheel of the
+// processes sleeping until a deadline, and sets its mtimecmp
+// for whichever comes first: the earliest deadline, or, while
+// it is running a process, the end of that process's tick,
+// so that it can be preempted. An idle hart with no sleepers
+// takes no timer interrupts at all, and a sleeper is woken
+// once, when its deadline passes, to the resolution of the
+// CLINT rather than of a tick.
+//
+// Times are in CLINT mtime cycles, read with rdtime. A tick,
+// the unit of sleep() and uptime(), is TICKCYCLES of them.
+//
+// The wheel has NSLOT slots, each holding the sleepers whose
+// deadlines fall in a SLOTCYCLES-long stretch, modulo a turn
+// of the wheel; those due in later turns wait in the slot,
+// keeping their exact deadlines. A timer interrupt looks at
+// the slots that have gone by since the last one.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define SLOTSHIFT 14                      // 1.6 ms per slot in qemu
+#define SLOTCYCLES (1L << SLOTSHIFT)
+#define NSLOT 64
+#define SLOT(t) (((t) >> SLOTSHIFT) % NSLOT)
+#define NEVER (~0L)
+
+struct wheel {
+  struct spinlock lock;
+  struct proc *slot[NSLOT];   // linked through p->tnext
+  uint64 last;                // time of the last look at the slots
+  uint64 next;                // earliest deadline, or NEVER
+  uint64 slice;               // end of the running process's tick, or NEVER
+  uint64 nintr;               // timer interrupts
+  uint64 nwoken;              // sleepers woken
+} wheels[NCPU];
+
+void
+clockinit(void)
+{
+  for(struct wheel *w = wheels; w < &wheels[NCPU]; w++){
+    initlock(&w->lock, "clock");
+    w->next = NEVER;
+    w->slice = NEVER;
+  }
+}
+
+// Ticks since boot.
+uint
+tickcount(void)
+{
+  return r_time() / TICKCYCLES;
+}
+
+// Set this hart's mtimecmp for the first of w's deadline
+// and tick end. Caller holds w->lock, on this hart.
+static void
+program(struct wheel *w)
+{
+  uint64 t = w->next < w->slice ? w->next : w->slice;
+
+  *(uint64*)KCLINT_MTIMECMP(cpuid()) = t;
+}
+
+// Return the earliest deadline of any sleeper in w,
+// looking at the slots in time order from now.
+// Caller holds w->lock.
+static uint64
+earliest(struct wheel *w, uint64 now)
+{
+  uint64 min, t;
+  struct proc *p;
+  int i;
+
+  min = NEVER;
+  for(i = 0, t = now; i < NSLOT; i++, t += SLOTCYCLES){
+    for(p = w->slot[SLOT(t)]; p; p = p->tnext)
+      if(p->deadline < min)
+        min = p->deadline;
+    // no later slot holds anything due before
+    // the end of this one's stretch.
+    if(min < (t & ~(SLOTCYCLES - 1)) + SLOTCYCLES)
+      break;
+  }
+  return min;
+}
+
+// Take p off w. Caller holds w->lock.
+static void
+unlink(struct wheel *w, struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &w->slot[SLOT(p->deadline)]; *pp != p; pp = &(*pp)->tnext)
+    ;
+  *pp = p->tnext;
+  p->wheel = -1;
+}
+
+// A timer interrupt on this hart: wake the sleepers whose
+// deadlines have passed, and set the next interrupt. Returns
+// 1 if the running process's tick is over, else 0.
+int
+clockintr(void)
+{
+  struct wheel *w = &wheels[cpuid()];
+  struct proc *p, **pp;
+  uint64 now, t;
+  int i, n, over;
+
+  acquire(&w->lock);
+  w->nintr++;
+  now = r_time();
+
+  // look at each slot that has gone by since last time,
+  // or all of them if a whole turn has.
+  n = ((now >> SLOTSHIFT) - (w->last >> SLOTSHIFT)) + 1;
+  if(n > NSLOT)
+    n = NSLOT;
+  for(i = 0, t = w->last; i < n; i++, t += SLOTCYCLES){
+    for(pp = &w->slot[SLOT(t)]; (p = *pp) != 0; ){
+      if(p->deadline <= now){
+        *pp = p->tnext;
+        p->wheel = -1;
+        w->nwoken++;
+        wakeup(&p->deadline);
+      } else {
+        pp = &p->tnext;
+      }
+    }
+  }
+  w->last = now;
+  w->next = earliest(w, now);
+
+  // another tick for a process that is still running.
+  over = 0;
+  if(w->slice <= now){
+    over = 1;
+    w->slice = mycpu()->proc ? now + TICKCYCLES : NEVER;
+  }
+  program(w);
+  release(&w->lock);
+  return over;
+}
+
+// This hart is about to run a process: make sure that a
+// timer interrupt will come within a tick, to preempt it.
+// Called by scheduler() with interrupts off.
+void
+clockrun(void)
+{
+  struct wheel *w = &wheels[cpuid()];
+
+  acquire(&w->lock);
+  if(w->slice == NEVER){
+    w->slice = r_time() + TICKCYCLES;
+    program(w);
+  }
+  release(&w->lock);
+}
+
+// Sleep until mtime reaches deadline. Returns 0,
+// or -1 if the process was killed meanwhile.
+int
+clocksleep(uint64 deadline)
+{
+  struct proc *p = myproc();
+  struct wheel *w;
+
+  // the wheel of the hart p is on now, whose
+  // mtimecmp can be set from here.
+  push_off();
+  w = &wheels[cpuid()];
+  acquire(&w->lock);
+  pop_off();
+  if(deadline <= r_time()){
+    release(&w->lock);
+    return 0;
+  }
+  p->deadline = deadline;
+  p->wheel = w - wheels;
+  p->tnext = w->slot[SLOT(deadline)];
+  w->slot[SLOT(deadline)] = p;
+  if(deadline < w->next){
+    w->next = deadline;
+    program(w);
+  }
+
+  // clockintr() takes p off the wheel when it wakes it.
+  while(p->wheel >= 0){
+    if(p->killed){
+      unlink(w, p);
+      release(&w->lock);
+      return -1;
+    }
+    sleep(&p->deadline, &w->lock);
+  }
+  release(&w->lock);
+  return 0;
+}
+
+// Report timer interrupts and wakeups for the statistics device.
+int
+clockstats(char *buf, int sz)
+{
+  int n = 0;
+
+  for(int i = 0; i < NCPU; i++){
+    struct wheel *w = &wheels[i];
+    if(w->nintr == 0)
+      continue;
+    n += snprintf(buf+n, sz-n, "clock cpu %d: intr %l woken %l\n",
+                  i, w->nintr, w->nwoken);
+  }
+  return n;
+}
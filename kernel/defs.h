@@ -2,13 +2,28 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct vma;
+struct kmem_cache;
 struct pipe;
 struct proc;
 struct spinlock;
+struct seg;
+struct shm;
 struct sleeplock;
+struct spawnact;
 struct stat;
 struct superblock;
 
+// asid.c
+void            asidinit(void);
+void            asidalloc(struct proc*);
+uint64          asidsatp(struct proc*, pagetable_t);
+void            asidflush(struct proc*);
+void            asidflushva(struct proc*, uint64);
+void            asidstale(struct proc*);
+void            asidintr(void);
+int             asidstats(char*, int);
+
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
@@ -17,6 +32,21 @@ void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
 
+// buddy.c
+void            buddyinit(void);
+void*           buddy_alloc(int);
+void            buddy_free(void *, int);
+void            buddy_free_range(void *, void *);
+int             buddystats(char*, int);
+
+// clock.c
+void            clockinit(void);
+uint            tickcount(void);
+int             clockintr(void);
+void            clockrun(void);
+int             clocksleep(uint64);
+int             clockstats(char*, int);
+
 // console.c
 void            consoleinit(void);
 void            consoleintr(int);
@@ -24,6 +54,10 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execproc(struct proc*, char*, char**);
+struct seg*     seglookup(struct proc*, uint64);
+int             segfault(struct proc*, struct seg*, uint64);
+void            segshrink(struct proc*, uint64);
 
 // file.c
 struct file*    filealloc(void);
@@ -34,6 +68,12 @@ int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
 
+// futex.c
+void            futexinit(void);
+int             futexwait(uint64, int);
+int             futexwake(uint64, int);
+int             futexstats(char*, int);
+
 // fs.c
 void            fsinit(int);
 int             dirlink(struct inode*, char*, uint);
@@ -62,7 +102,15 @@ void            ramdiskrw(struct buf*);
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
+void            krefinc(void *);
+int             krefcnt(void *);
 void            kinit(void);
+uint64          kpopulate(void);
+int             kallocstats(char*, int);
+void*           kalloc_zeroed(void);
+int             kzero_refill(void);
+void*           kalloc_pages(int);
+void            kfree_pages(void *, int);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -70,7 +118,20 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// main.c
+int             bootstats(char*, int);
+
+// mmap.c
+struct vma*     vmalookup(struct proc*, uint64);
+uint64          mmapbase(struct proc*);
+int             mmapfault(struct proc*, struct vma*, uint64, int);
+void            mmapexit(struct proc*);
+int             mmapfork(struct proc*, struct proc*);
+uint64          mmap(struct file*, uint64, int, int, uint64);
+int             munmap(uint64, uint64);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -85,11 +146,18 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             spawn(char*, char**, struct spawnact*, int);
 int             growproc(int);
+void            vmlock(struct proc*);
+void            vmunlock(struct proc*);
+int             clone(uint64, uint64, uint64);
+int             join(uint64);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+int             setpriority(int, int);
+int             getpriority(int);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -100,21 +168,58 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+int             waitstats(char*, int);
+
+// runq.c
+void            runqinit(void);
+void            runqstart(int);
+int             runqpick(void);
+void            setrunnable(struct proc*);
+struct proc*    runqget(int);
+void            runqmove(struct proc*);
+int             timeslice(struct proc*);
+void            runqidle(int);
+int             runqstats(char*, int);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
 
+// sprintf.c
+int             snprintf(char*, int, char*, ...);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initticketlock(struct spinlock*, char*);
+void            freelock(struct spinlock*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+int             lockstat(uint64, int);
+
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+int             kmem_cache_reap(void);
+void*           kmalloc(uint);
+void            kmfree(void*);
+int             slabstats(char*, int);
+
+// shm.c
+void            shminit(void);
+struct file*    shmopen(char*, uint64, int);
+void            shmclose(struct shm*);
+int             shmunlink(char*);
+int             shmmap(pagetable_t, struct shm*, uint64, uint64, uint64, int);
+int             shmstats(char*, int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -122,6 +227,9 @@ void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
+// stats.c
+void            statsinit(void);
+
 // string.c
 int             memcmp(const void*, const void*, uint);
 void*           memmove(void*, const void*, uint);
@@ -131,6 +239,14 @@ int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
 
+// swap.c
+void            swapinit(int, struct superblock*);
+int             swapout(void);
+int             swapin(pte_t*);
+void            swapdup(int);
+void            swapfree(int);
+int             swapstats(char*, int);
+
 // syscall.c
 int             argint(int, int*);
 int             argstr(int, char*, int);
@@ -139,11 +255,19 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// sysfile.c
+struct file*    fileopen(char*, int);
+
+// text.c
+void            textinit(void);
+char*           textget(struct inode*, uint, int);
+void            textinval(struct inode*);
+int             textreap(void);
+int             textstats(char*, int);
+
 // trap.c
-extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
-extern struct spinlock tickslock;
 void            usertrapret(void);
 
 // uart.c
@@ -155,7 +279,12 @@ int             uartgetc(void);
 
 // vm.c
 void            kvminit(void);
+int             kvmstats(char*, int);
 void            kvminithart(void);
+pagetable_t     kvmcreate(pagetable_t);
+void            kvmfree(pagetable_t);
+void            kvmswitch(struct proc*);
+int             ucopytrap(uint64*, uint64, int);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
@@ -163,10 +292,15 @@ void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopyrange(pagetable_t, pagetable_t, uint64, uint64, int);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
+int             vmfault(pagetable_t, uint64, int);
+int             vmfill(pagetable_t, uint64, char*, int);
+void            uvmprefault(uint64, uint64, int);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
@@ -5,21 +5,57 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 #include "elf.h"
 
+#ifdef EAGEREXEC
 static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
+#endif
+
+#ifndef EAGEREXEC
+// PTE permissions for a segment with ELF flags f.
+static int
+flags2perm(int f)
+{
+  int perm = PTE_R|PTE_U;
+
+  if(f & ELF_PROG_FLAG_EXEC)
+    perm |= PTE_X;
+  if(f & ELF_PROG_FLAG_WRITE)
+    perm |= PTE_W;
+  return perm;
+}
+#endif
 
 int
 exec(char *path, char **argv)
+{
+  struct proc *p = myproc();
+
+  // other threads would go on running in the old image.
+  if(p->main != p || p->nthread > 1)
+    return -1;
+  return execproc(p, path, argv);
+}
+
+// Replace p's user image with the program at path, run with
+// argv. p is the caller, or a new child of the caller's that
+// spawn() is building and that has not run yet. The program
+// is looked up in the caller's current directory.
+// Returns argc, or -1 with p unchanged.
+int
+execproc(struct proc *p, char *path, char **argv)
 {
   char *s, *last;
-  int i, off;
+  int i, off, nseg = 0;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exip = 0, *oldexip;
+  struct seg seg[NSEG];
   struct proghdr ph;
-  pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
+  pagetable_t pagetable = 0, oldpagetable, kpagetable = 0, oldkpagetable;
 
   begin_op();
 
@@ -37,6 +73,8 @@ exec(char *path, char **argv)
 
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
+  if((kpagetable = kvmcreate(pagetable)) == 0)
+    goto bad;
 
   // Load program into memory.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
@@ -48,26 +86,50 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
+    if((ph.vaddr % PGSIZE) != 0)
+      goto bad;
+    if(ph.vaddr + ph.memsz > UVMTOP)
+      goto bad;
+#ifdef EAGEREXEC
     uint64 sz1;
     if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
       goto bad;
     sz = sz1;
-    if((ph.vaddr % PGSIZE) != 0)
-      goto bad;
     if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
+#else
+    // only record the segment; segfault() reads
+    // each page in when it is first touched.
+    if(nseg >= NSEG)
+      goto bad;
+    seg[nseg].va = ph.vaddr;
+    seg[nseg].memsz = ph.memsz;
+    seg[nseg].off = ph.off;
+    seg[nseg].filesz = ph.filesz;
+    seg[nseg].perm = flags2perm(ph.flags);
+    nseg++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
+#endif
   }
-  iunlockput(ip);
+  // keep a reference to the program file
+  // for as long as the image may fault.
+  if(nseg > 0){
+    iunlock(ip);
+    exip = ip;
+  } else
+    iunlockput(ip);
   end_op();
   ip = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate two pages at the next page boundary.
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
   uint64 sz1;
+  if(sz + 2*PGSIZE > UVMTOP)
+    goto bad;
   if((sz1 = uvmalloc(pagetable, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
   sz = sz1;
@@ -109,25 +171,140 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
+  mmapexit(p);
   oldpagetable = p->pagetable;
+  oldkpagetable = p->kpagetable;
+  oldexip = p->exip;
   p->pagetable = pagetable;
+  p->kpagetable = kpagetable;
+  asidalloc(p);
+  if(p == myproc())
+    kvmswitch(p);
   p->sz = sz;
+  p->exip = exip;
+  memmove(p->seg, seg, sizeof(seg));
+  p->nseg = nseg;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
+  kvmfree(oldkpagetable);
   proc_freepagetable(oldpagetable, oldsz);
+  if(oldexip){
+    begin_op();
+    iput(oldexip);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
+  if(kpagetable)
+    kvmfree(kpagetable);
   if(pagetable)
     proc_freepagetable(pagetable, sz);
   if(ip){
     iunlockput(ip);
     end_op();
   }
+  if(exip){
+    begin_op();
+    iput(exip);
+    end_op();
+  }
   return -1;
 }
 
+// Return the segment of p's program that contains va, or 0.
+struct seg*
+seglookup(struct proc *p, uint64 va)
+{
+  struct seg *s;
+
+  for(s = p->seg; s < &p->seg[p->nseg]; s++)
+    if(va >= s->va && va < s->va + s->memsz)
+      return s;
+  return 0;
+}
+
+// Read in the page of segment s that holds va, which was
+// touched for the first time. Pages of read-only segments
+// come from the text cache, shared with other processes
+// running the same program. p is a main thread, and the
+// caller holds vmlock(p). Returns 0 on success, -1
+// if the file could not be read or memory ran out.
+int
+segfault(struct proc *p, struct seg *s, uint64 va)
+{
+  struct inode *ip = p->exip;
+  uint64 done;
+  char *mem;
+  int n, locked;
+
+  va = PGROUNDDOWN(va);
+  done = va - s->va;
+  n = 0;
+  if(done < s->filesz)
+    n = s->filesz - done < PGSIZE ? s->filesz - done : PGSIZE;
+
+  if(n == 0){
+    if((mem = kalloc_zeroed()) == 0)
+      return -1;
+  } else {
+    // a read() by this thread into its own data or bss
+    // holds the inode lock already. a copy by readi() or
+    // writei() on another inode must fail instead; see the
+    // lock order in mmap.c.
+    locked = holdingsleep(&ip->lock);
+    if(!locked && myproc()->nilock > 0)
+      return -1;
+    // a thread may be in a read() of the program file
+    // that faults, holding the inode lock and waiting
+    // for vmlock(), so let go of vmlock() here.
+    vmunlock(p);
+    if(!locked)
+      ilock(ip);
+    if(s->perm & PTE_W){
+      if((mem = kalloc_zeroed()) != 0 &&
+         readi(ip, 0, (uint64)mem, s->off + done, n) != n){
+        kfree(mem);
+        mem = 0;
+      }
+    } else {
+      mem = textget(ip, s->off + done, n);
+    }
+    if(!locked)
+      iunlock(ip);
+    vmlock(p);
+    if(mem == 0)
+      return -1;
+    // sbrk() may have shrunk s meanwhile.
+    if(seglookup(p, va) != s){
+      kfree(mem);
+      return -1;
+    }
+  }
+
+  return vmfill(p->pagetable, va, mem, s->perm);
+}
+
+// The process is shrinking to sz bytes: forget the part
+// of each segment above sz, so that memory grown again
+// later reads as zero rather than as the program file.
+void
+segshrink(struct proc *p, uint64 sz)
+{
+  struct seg *s;
+
+  for(s = p->seg; s < &p->seg[p->nseg]; s++){
+    if(sz <= s->va)
+      s->memsz = 0;
+    else if(sz < s->va + s->memsz)
+      s->memsz = sz - s->va;
+    if(s->filesz > s->memsz)
+      s->filesz = s->memsz;
+  }
+}
+
+#ifdef EAGEREXEC
 // Load a program segment into pagetable at virtual address va.
 // va must be page-aligned
 // and the pages from va to va+sz must already be mapped.
@@ -152,3 +329,4 @@ loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz
   
   return 0;
 }
+#endif
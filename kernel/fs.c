@@ -44,6 +44,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  swapinit(dev, &sb);
 }
 
 // Zero a block.
@@ -295,6 +296,7 @@ ilock(struct inode *ip)
     panic("ilock");
 
   acquiresleep(&ip->lock);
+  myproc()->nilock++;
 
   if(ip->valid == 0){
     bp = bread(ip->dev, IBLOCK(ip->inum, sb));
@@ -307,6 +309,9 @@ ilock(struct inode *ip)
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
     ip->valid = 1;
+    // the text cache may still hold pages from an
+    // earlier time this inode was in the table.
+    ip->text = 1;
     if(ip->type == 0)
       panic("ilock: no type");
   }
@@ -319,6 +324,7 @@ iunlock(struct inode *ip)
   if(ip == 0 || !holdingsleep(&ip->lock) || ip->ref < 1)
     panic("iunlock");
 
+  myproc()->nilock--;
   releasesleep(&ip->lock);
 }
 
@@ -413,6 +419,8 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  if(ip->text)
+    textinval(ip);
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -493,6 +501,8 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  if(ip->text)
+    textinval(ip);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
@@ -629,11 +639,17 @@ static struct inode*
 namex(char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
+  struct proc *m;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(myproc()->cwd);
+  else {
+    // another thread may be changing it; see sys_chdir().
+    m = myproc()->main;
+    acquire(&m->lock);
+    ip = idup(m->cwd);
+    release(&m->lock);
+  }
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
@@ -0,0 +1,164 @@
+//
+// Futexes: blocking on a word of user memory.
+//
+// futex_wait(addr, val) sleeps if the int at addr still holds
+// val, and futex_wake(addr, n) wakes up to n of those sleeping
+// on addr, so that user locks need enter the kernel only when
+// they are contended. The user library in user/usync.c builds
+// mutexes and condition variables this way.
+//
+// A futex in a MAP_SHARED mapping, which other processes may
+// map at other addresses, is named by the physical address of
+// its word. Any other futex is private to the threads of one
+// process, and is named by the process and the word's virtual
+// address instead, since copy-on-write after a fork() or
+// swapping may move the word to another physical page while
+// threads sleep on it. The sleepers on a futex sleep() on its
+// name. The word is read under one of a hash table of locks,
+// which futexwake() acquires too, so that a waker who changed
+// the word before calling futex_wake() cannot slip in between
+// a sleeper's look at it and its sleep(). The sleeper also
+// holds vmlock() until it has read the word, so that no
+// thread can unmap the page and free it meanwhile.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "fcntl.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NFUTEXLOCK 16
+
+extern struct proc proc[NPROC];
+
+struct futexlock {
+  struct spinlock lock;
+  uint64 nwait;    // futex_wait() calls that slept
+  uint64 nagain;   // that found the word changed
+  uint64 nwake;    // futex_wake() calls
+  uint64 nwoken;   // processes they woke
+} futexlocks[NFUTEXLOCK];
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEXLOCK; i++)
+    initlock(&futexlocks[i].lock, "futex");
+}
+
+static struct futexlock*
+futexlock(uint64 key)
+{
+  return &futexlocks[(key / sizeof(int)) % NFUTEXLOCK];
+}
+
+// Return the physical address of the int at user address va,
+// faulting its page in if need be, with vmlock() held so that
+// the page stays put; or 0 if va is not mapped. A copy-on-write
+// page is copied first, since the process's next store to it
+// would move the word elsewhere. Set *key to the futex's name:
+// the physical address, or for a private futex the main
+// thread's slot and va, above MAXVA so as to differ from any
+// physical address or kernel pointer.
+static uint64
+futexaddr(uint64 va, uint64 *key)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  pte_t *pte;
+  uint64 pa;
+  int cow;
+
+  if(va % sizeof(int) != 0 || va >= MAXVA)
+    return 0;
+  for(;;){
+    if(p->killed)
+      return 0;
+    vmlock(p);
+    pa = cow = 0;
+    pte = walk(p->pagetable, va, 0);
+    if(pte && (*pte & (PTE_V|PTE_U)) == (PTE_V|PTE_U)){
+      if(*pte & PTE_COW)
+        cow = 1;
+      else
+        pa = PTE2PA(*pte) + (va & (PGSIZE-1));
+    }
+    if(pa){
+      if((v = vmalookup(p->main, va)) != 0 && (v->flags & MAP_SHARED))
+        *key = pa;
+      else
+        *key = ((uint64)(p->main - proc) + 1) << 40 | va;
+      return pa;
+    }
+    vmunlock(p);
+    if(vmfault(p->pagetable, va, cow) < 0)
+      return 0;
+  }
+}
+
+// Sleep on the futex at user address addr if it holds val.
+// Returns 0 once woken, or -1 if the word held something
+// else, addr is bad, or the process was killed.
+int
+futexwait(uint64 addr, int val)
+{
+  struct proc *p = myproc();
+  struct futexlock *fl;
+  uint64 pa, key;
+
+  if((pa = futexaddr(addr, &key)) == 0)
+    return -1;
+  fl = futexlock(key);
+  acquire(&fl->lock);
+  if(*(int*)pa != val){
+    fl->nagain++;
+    release(&fl->lock);
+    vmunlock(p);
+    return -1;
+  }
+  vmunlock(p);
+  fl->nwait++;
+  sleep((void*)key, &fl->lock);
+  release(&fl->lock);
+  return p->killed ? -1 : 0;
+}
+
+// Wake up to n of the processes sleeping on the futex
+// at user address addr. Returns how many, or -1.
+int
+futexwake(uint64 addr, int n)
+{
+  struct futexlock *fl;
+  uint64 key;
+
+  if(n < 0 || futexaddr(addr, &key) == 0)
+    return -1;
+  vmunlock(myproc());
+  fl = futexlock(key);
+  acquire(&fl->lock);
+  n = wakeupn((void*)key, n);
+  fl->nwake++;
+  fl->nwoken += n;
+  release(&fl->lock);
+  return n;
+}
+
+// Report futex use for the statistics device.
+int
+futexstats(char *buf, int sz)
+{
+  uint64 nwait = 0, nagain = 0, nwake = 0, nwoken = 0;
+
+  for(struct futexlock *fl = futexlocks; fl < &futexlocks[NFUTEXLOCK]; fl++){
+    nwait += fl->nwait;
+    nagain += fl->nagain;
+    nwake += fl->nwake;
+    nwoken += fl->nwoken;
+  }
+  return snprintf(buf, sz, "futex: wait %l again %l wake %l woken %l\n",
+                  nwait, nagain, nwake, nwoken);
+}
@@ -1,6 +1,33 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and slabs of small objects (slab.c). Allocates whole 4096-byte pages,
+// or with kalloc_pages() contiguous runs of 2^order pages.
+//
+// Free memory lives in the buddy allocator (buddy.c).
+// On top of it each CPU caches single pages on its own
+// free list and lock, so that CPUs allocating and freeing
+// concurrently don't serialize on a single lock. kfree()
+// puts the page on the current CPU's list; kalloc() takes
+// from it, and when it is empty refills a batch from the
+// buddy allocator, or failing that steals from another
+// CPU's list. Lists that grow past KMEMHIGH give half
+// back to the buddy allocator so it can coalesce them.
+//
+// kinit() hands only the first chunk of RAM to the buddy
+// allocator. kpopulate() adds the rest a chunk at a time,
+// either when kalloc() runs short or, during boot, from the
+// harts waiting in main() for hart 0 to finish.
+//
+// Pages are only filled with junk on allocation and free
+// in kernels built with JUNKFILL (make JUNKFILL=1).
+// kalloc_zeroed() hands out pages cleared ahead of time by
+// idle harts (see kzero_refill()), so that callers who need
+// a zeroed page don't pay for clearing it.
+//
+// Each page from kalloc() has a reference count, starting
+// at 1, so that copy-on-write fork can share pages between
+// processes: krefinc() adds a reference, and kfree() drops
+// one and frees the page only when none are left.
 
 #include "types.h"
 #include "param.h"
@@ -9,11 +36,24 @@
 #include "riscv.h"
 #include "defs.h"
 
-void freerange(void *pa_start, void *pa_end);
-
 extern char end[]; // first address after kernel.
                    // defined by kernel.ld.
 
+// most pages kalloc() moves from one CPU's list to another's.
+#define NSTEAL 64
+// order of the block kalloc() takes from the buddy allocator
+// when a CPU's list is empty.
+#define REFILLORDER 4
+// a CPU's list longer than this is trimmed by half.
+#define KMEMHIGH 256
+// most pre-zeroed pages kept for kalloc_zeroed().
+#define NZERO 128
+// most pages kzero_refill() clears per call.
+#define ZEROBATCH 8
+// kpopulate() hands RAM to the buddy allocator in blocks
+// of the largest order.
+#define POPCHUNK ((uint64)PGSIZE << MAXORDER)
+
 struct run {
   struct run *next;
 };
@@ -21,45 +61,235 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
-} kmem;
+  int nfree;        // pages on freelist
+  uint64 nsteal;    // pages stolen from other CPUs
+  uint64 ncontend;  // acquires that found lock held
+} kmem[NCPU];
+
+struct {
+  struct spinlock lock;
+  struct run *list;   // zeroed but for the first word
+  int n;
+  uint64 nhit;        // kalloc_zeroed() served from the pool
+  uint64 nmiss;       // kalloc_zeroed() had to clear a page
+} kzero;
+
+// RAM in [next, PHYSTOP) has not yet been given to the
+// buddy allocator.
+struct {
+  struct spinlock lock;
+  volatile int ready;   // lock and next are initialized
+  uint64 next;
+  int nchunk[NCPU];     // chunks populated by each CPU
+} kpop;
+
+static int kzero_drain(void);
+
+// reference counts of pages handed out by kalloc().
+static int pgref[(PHYSTOP - KERNBASE) / PGSIZE];
+#define PGREF(pa) pgref[((uint64)(pa) - KERNBASE) / PGSIZE]
 
 void
 kinit()
 {
-  initlock(&kmem.lock, "kmem");
-  freerange(end, (void*)PHYSTOP);
+  for(int i = 0; i < NCPU; i++)
+    initticketlock(&kmem[i].lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  buddyinit();
+  initlock(&kpop.lock, "kpop");
+  kpop.next = PGROUNDUP((uint64)end);
+  __sync_synchronize();
+  kpop.ready = 1;
+  kpopulate();
 }
 
-void
-freerange(void *pa_start, void *pa_end)
+// Give the next chunk of unpopulated RAM to the buddy allocator.
+// Safe to call on any hart, before or after kinit().
+// Returns the number of bytes added, 0 once all RAM is populated.
+uint64
+kpopulate(void)
 {
-  char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
-    kfree(p);
+  uint64 start, stop;
+
+  if(!kpop.ready)
+    return 0;
+  __sync_synchronize();
+
+  acquire(&kpop.lock);
+  start = kpop.next;
+  if(start >= PHYSTOP){
+    release(&kpop.lock);
+    return 0;
+  }
+  // end at a chunk boundary, so later chunks are whole blocks.
+  stop = KERNBASE + ((start - KERNBASE) / POPCHUNK + 1) * POPCHUNK;
+  if(stop > PHYSTOP)
+    stop = PHYSTOP;
+  kpop.next = stop;
+  kpop.nchunk[cpuid()]++;
+  release(&kpop.lock);
+
+#ifdef JUNKFILL
+  memset((void*)start, 1, stop - start);
+#endif
+  buddy_free_range((void*)start, (void*)stop);
+  return stop - start;
+}
+
+// Acquire CPU id's kmem lock, counting contention.
+static void
+kmemlock(int id)
+{
+  if(kmem[id].lock.locked)
+    kmem[id].ncontend++;
+  acquire(&kmem[id].lock);
+}
+
+// Return this CPU's index into kmem[].
+// The answer may be stale by the time it is used,
+// which only costs some locality.
+static int
+kmemid(void)
+{
+  int id;
+
+  push_off();
+  id = cpuid();
+  pop_off();
+  return id;
+}
+
+// Take up to n pages off CPU id's list and give them
+// back to the buddy allocator. Returns the number moved.
+static int
+kdrain(int id, int n)
+{
+  struct run *r, *list;
+  int i;
+
+  list = 0;
+  kmemlock(id);
+  for(i = 0; i < n && (r = kmem[id].freelist) != 0; i++){
+    kmem[id].freelist = r->next;
+    r->next = list;
+    list = r;
+  }
+  kmem[id].nfree -= i;
+  release(&kmem[id].lock);
+
+  while((r = list) != 0){
+    list = r->next;
+    buddy_free(r, 0);
+  }
+  return i;
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
+// call to kalloc(), and free it if that was the last.
 void
 kfree(void *pa)
 {
   struct run *r;
+  int id, n;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if((n = __sync_sub_and_fetch(&PGREF(pa), 1)) > 0)
+    return;
+  if(n < 0)
+    panic("kfree: ref");
+
+#ifdef JUNKFILL
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  id = kmemid();
+  kmemlock(id);
+  r->next = kmem[id].freelist;
+  kmem[id].freelist = r;
+  n = ++kmem[id].nfree;
+  release(&kmem[id].lock);
+
+  if(n > KMEMHIGH)
+    kdrain(id, n / 2);
+}
+
+// Take a block from the buddy allocator, as large as
+// REFILLORDER, and put its pages on CPU id's list.
+// Returns the number of pages added.
+static int
+krefill(int id)
+{
+  struct run *first, *r;
+  char *p;
+  int k, n;
+
+  for(k = REFILLORDER; k >= 0; k--)
+    if((p = buddy_alloc(k)) != 0)
+      break;
+  if(k < 0)
+    return 0;
+  n = 1 << k;
+
+  // chain the pages together before taking the lock.
+  first = (struct run*)p;
+  for(int i = 0; i < n - 1; i++){
+    r = (struct run*)(p + i*PGSIZE);
+    r->next = (struct run*)(p + (i+1)*PGSIZE);
+  }
+  r = (struct run*)(p + (n-1)*PGSIZE);
+
+  kmemlock(id);
+  r->next = kmem[id].freelist;
+  kmem[id].freelist = first;
+  kmem[id].nfree += n;
+  release(&kmem[id].lock);
+  return n;
+}
+
+// Move up to NSTEAL pages (half of the victim's list)
+// from some other CPU's free list to CPU id's.
+// Never holds two kmem locks at once.
+// Returns the number of pages moved.
+static int
+ksteal(int id)
+{
+  struct run *first, *last;
+  int i, n, victim;
+
+  for(i = 1; i < NCPU; i++){
+    victim = (id + i) % NCPU;
+    if(kmem[victim].freelist == 0)
+      continue;
+    kmemlock(victim);
+    n = (kmem[victim].nfree + 1) / 2;
+    if(n > NSTEAL)
+      n = NSTEAL;
+    first = last = kmem[victim].freelist;
+    if(first == 0){
+      release(&kmem[victim].lock);
+      continue;
+    }
+    for(int j = 1; j < n; j++)
+      last = last->next;
+    kmem[victim].freelist = last->next;
+    kmem[victim].nfree -= n;
+    release(&kmem[victim].lock);
+
+    kmemlock(id);
+    last->next = kmem[id].freelist;
+    kmem[id].freelist = first;
+    kmem[id].nfree += n;
+    kmem[id].nsteal += n;
+    release(&kmem[id].lock);
+    return n;
+  }
+  return 0;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +299,195 @@ void *
 kalloc(void)
 {
   struct run *r;
+  int id, reaped;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  id = kmemid();
+  reaped = 0;
+  for(;;){
+    kmemlock(id);
+    r = kmem[id].freelist;
+    if(r){
+      kmem[id].freelist = r->next;
+      kmem[id].nfree--;
+    }
+    release(&kmem[id].lock);
+    if(r)
+      break;
+    if(krefill(id) > 0 || kpopulate() > 0 || ksteal(id) > 0)
+      continue;
+    // last resorts: free the zero pool, slabs held only
+    // by slab magazines, and unused cached program text;
+    // then write process memory out to swap.
+    if(!reaped){
+      reaped = 1;
+      if(kzero_drain() + kmem_cache_reap() + textreap() > 0)
+        continue;
+    }
+    if(swapout() == 0)
+      break;
+  }
 
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
+  if(r == 0)
+    return 0;
+  PGREF(r) = 1;
+#ifdef JUNKFILL
+  memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
   return (void*)r;
 }
+
+// Add a reference to a page returned by kalloc().
+void
+krefinc(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("krefinc");
+  __sync_fetch_and_add(&PGREF(pa), 1);
+}
+
+// Return the number of references to a page returned by kalloc().
+int
+krefcnt(void *pa)
+{
+  return __atomic_load_n(&PGREF(pa), __ATOMIC_SEQ_CST);
+}
+
+// Allocate one page of physical memory filled with zeros.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  acquire(&kzero.lock);
+  r = kzero.list;
+  if(r){
+    kzero.list = r->next;
+    kzero.n--;
+    kzero.nhit++;
+  } else {
+    kzero.nmiss++;
+  }
+  release(&kzero.lock);
+
+  if(r){
+    r->next = 0;
+    return (void*)r;
+  }
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
+  return (void*)r;
+}
+
+// Clear a few pages for kalloc_zeroed() if the pool is
+// not full. Called by scheduler() when it finds nothing
+// to run, so that the clearing is done by idle harts.
+// Returns the number of pages cleared.
+int
+kzero_refill(void)
+{
+  struct run *r;
+  int i;
+
+  for(i = 0; i < ZEROBATCH && kzero.n < NZERO; i++){
+    if((r = kalloc()) == 0)
+      break;
+    memset((char*)r, 0, PGSIZE);
+    acquire(&kzero.lock);
+    r->next = kzero.list;
+    kzero.list = r;
+    kzero.n++;
+    release(&kzero.lock);
+  }
+  return i;
+}
+
+// Give the pre-zeroed pages back to the free lists.
+// Returns the number of pages freed.
+static int
+kzero_drain(void)
+{
+  struct run *r, *list;
+  int n;
+
+  acquire(&kzero.lock);
+  list = kzero.list;
+  n = kzero.n;
+  kzero.list = 0;
+  kzero.n = 0;
+  release(&kzero.lock);
+
+  while((r = list) != 0){
+    list = r->next;
+    kfree(r);
+  }
+  return n;
+}
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their size relative to KERNBASE.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_pages(int order)
+{
+  char *pa;
+
+  if(order == 0)
+    return kalloc();
+
+  while((pa = buddy_alloc(order)) == 0 && kpopulate() > 0)
+    ;
+  if(pa == 0){
+    // pages cached on the per-CPU lists and in slabs may be
+    // what keeps buddies from merging; hand them all back
+    // and retry.
+    kzero_drain();
+    kmem_cache_reap();
+    for(int i = 0; i < NCPU; i++)
+      kdrain(i, kmem[i].nfree);
+    if((pa = buddy_alloc(order)) == 0)
+      return 0;
+  }
+#ifdef JUNKFILL
+  memset(pa, 5, PGSIZE << order); // fill with junk
+#endif
+  return pa;
+}
+
+// Free 2^order pages returned by kalloc_pages(order).
+void
+kfree_pages(void *pa, int order)
+{
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  if((char*)pa < end)
+    panic("kfree_pages");
+#ifdef JUNKFILL
+  memset(pa, 1, PGSIZE << order);
+#endif
+  buddy_free(pa, order);
+}
+
+// Report per-CPU free list sizes and contention
+// for the statistics device.
+int
+kallocstats(char *buf, int sz)
+{
+  int n;
+
+  n = 0;
+  for(int i = 0; i < NCPU; i++){
+    n += snprintf(buf+n, sz-n, "kmem cpu%d: free %d steal %l contend %l\n",
+                  i, kmem[i].nfree, kmem[i].nsteal, kmem[i].ncontend);
+  }
+  n += snprintf(buf+n, sz-n, "kzero: pool %d hit %l miss %l\n",
+                kzero.n, kzero.nhit, kzero.nmiss);
+  n += snprintf(buf+n, sz-n, "kpop: unpopulated %l KB, chunks by cpu",
+                (PHYSTOP - kpop.next) / 1024);
+  for(int i = 0; i < NCPU; i++)
+    n += snprintf(buf+n, sz-n, " %d", kpop.nchunk[i]);
+  n += snprintf(buf+n, sz-n, "\n");
+  return n;
+}
@@ -0,0 +1,10 @@
+// A lock's counters, as copied out by lockstat().
+#define LOCKNAME 16
+
+struct lockstat {
+  char name[LOCKNAME];
+  int isticket;      // a ticket lock, or test-and-set
+  uint64 nacquire;   // times acquired
+  uint64 ncontend;   // of which it was held by another cpu
+  uint64 nspin;      // loops spent waiting for it
+};
@@ -6,19 +6,28 @@
 
 volatile static int started = 0;
 
+// time CSR values, for reporting how long boot took.
+static uint64 boot_kinit, boot_done;
+
 // start() jumps here in supervisor mode on all CPUs.
 void
 main()
 {
+  uint64 t0;
+
   if(cpuid() == 0){
+    t0 = r_time();
     consoleinit();
     printfinit();
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
     kinit();         // physical page allocator
+    boot_kinit = r_time() - t0;
+    slabinit();      // small object caches
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    asidinit();      // address-space IDs
     procinit();      // process table
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
@@ -27,13 +36,23 @@ main()
     binit();         // buffer cache
     iinit();         // inode table
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    shminit();       // shared memory segments
+    futexinit();     // futex locks
+    textinit();      // shared program text cache
+    statsinit();     // statistics device
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
+    boot_done = r_time();
+    printf("boot: %d us, kinit %d us\n",
+           (int)(boot_done * 1000000 / MTIMEFREQ),
+           (int)(boot_kinit * 1000000 / MTIMEFREQ));
     __sync_synchronize();
     started = 1;
   } else {
+    // help hart 0 by handing free RAM to the allocator.
     while(started == 0)
-      ;
+      kpopulate();
     __sync_synchronize();
     printf("hart %d starting\n", cpuid());
     kvminithart();    // turn on paging
@@ -43,3 +62,12 @@ main()
 
   scheduler();        
 }
+
+// Report boot time for the statistics device.
+int
+bootstats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "boot: %l us, kinit %l us\n",
+                  boot_done * 1000000 / MTIMEFREQ,
+                  boot_kinit * 1000000 / MTIMEFREQ);
+}
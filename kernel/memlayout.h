@@ -29,6 +29,10 @@
 #define CLINT 0x2000000L
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid))
+#define MTIMEFREQ 10000000L // CLINT_MTIME cycles per second in qemu.
+#define TICKCYCLES (MTIMEFREQ / 10) // cycles per clock tick.
+#define NSPERCYCLE (1000000000L / MTIMEFREQ)
 
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
@@ -41,6 +45,12 @@
 #define PLIC_MCLAIM(hart) (PLIC + 0x200004 + (hart)*0x2000)
 #define PLIC_SCLAIM(hart) (PLIC + 0x201004 + (hart)*0x2000)
 
+// the CLINT lies in the range of user addresses, so the kernel
+// maps it here instead, above UVMTOP.
+#define KCLINT (PLIC + 0x400000)
+#define KCLINT_MSIP(hartid) (KCLINT + 4*(hartid))
+#define KCLINT_MTIMECMP(hartid) (KCLINT + 0x4000 + 8*(hartid))
+
 // the kernel expects there to be RAM
 // for use by the kernel and user pages
 // from physical address 0x80000000 to PHYSTOP.
@@ -62,6 +72,26 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   mmap() regions
+//   UVMTOP
+//   ...
+//   THREADFRAME(i) (the trapframes of threads; see clone())
+//   (the kernel stacks, in the kernel's page tables)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// a thread's kernel page table and user page table share an
+// ASID, so the trampoline may use TLB entries from either;
+// thread trapframes therefore lie below all the kernel stacks,
+// where no kernel page table maps anything.
+#define THREADFRAME(i) (KSTACK(NPROC) - (i)*PGSIZE)
+
+// user memory stays below the kernel's device mappings,
+// so that each process's kernel page table can map it
+// at the same addresses (see kvmcreate()).
+#define UVMTOP PLIC
+
+// mmap() places regions top-down below MMAPTOP;
+// the heap may grow up to the lowest of them.
+#define MMAPTOP UVMTOP
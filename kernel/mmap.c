@@ -0,0 +1,352 @@
+//
+// Memory-mapped files: mmap() and munmap().
+//
+// Each process has a table of VMAs describing its mapped
+// regions. mmap() only fills in a VMA; vmfault() calls
+// mmapfault() to read each page from the file the first
+// time it is touched. Pages of MAP_SHARED mappings that the
+// process wrote (PTE_D) are written back to the file, through
+// the log, when they are unmapped, including at exit and exec.
+// MAP_PRIVATE pages are never written back.
+//
+// A shared memory segment from shmopen() is mapped in full
+// by mmap() itself, since its pages already exist; it can
+// only be mapped MAP_SHARED, and there is nothing to write
+// back.
+//
+// The VMAs are the main thread's, shared by its threads (see
+// clone()), and vmlock() protects them. It is not held while
+// reading or writing the file, since another thread may hold
+// the inode lock, or be in a log transaction, and fault.
+//
+// A page fault never acquires an inode lock while the process
+// holds another: a copy by readi() or writei() of one file to
+// or from a mapped page of another, if two processes did it
+// the opposite ways round, would deadlock. fileread() and
+// filewrite() fault such pages in with uvmprefault() before
+// they lock the inode, and mmapfault() and segfault() (for
+// program pages) refuse to take the lock if one is held anyway.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+#include "proc.h"
+
+// Return the VMA of p that contains va, or 0.
+struct vma*
+vmalookup(struct proc *p, uint64 va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->used && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// Return the lowest address mapped by p, or MMAPTOP if
+// none is; the heap must stay below it.
+uint64
+mmapbase(struct proc *p)
+{
+  struct vma *v;
+  uint64 base;
+
+  base = MMAPTOP;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->used && v->addr < base)
+      base = v->addr;
+  return base;
+}
+
+// The PTE permissions for a mapping with protection prot.
+// Writable pages are readable too, since RISC-V reserves
+// PTE_W without PTE_R.
+static int
+protperm(int prot)
+{
+  int perm;
+
+  perm = PTE_U;
+  if(prot & PROT_READ)
+    perm |= PTE_R;
+  if(prot & PROT_WRITE)
+    perm |= PTE_R | PTE_W;
+  if(prot & PROT_EXEC)
+    perm |= PTE_X;
+  return perm;
+}
+
+// Fill in a page of v that was touched for the first time.
+// p is a main thread, and the caller holds vmlock(p).
+// Returns 0 on success, -1 if the access is not allowed
+// or memory ran out.
+int
+mmapfault(struct proc *p, struct vma *v, uint64 va, int write)
+{
+  struct inode *ip;
+  struct file *f;
+  uint64 off;
+  char *mem;
+  int locked, perm, r;
+
+  if(write && (v->prot & PROT_WRITE) == 0)
+    return -1;
+  if(!write && (v->prot & (PROT_READ|PROT_EXEC)) == 0)
+    return -1;
+  if(v->f->type != FD_INODE)
+    return -1;    // a segment is mapped in full
+
+  // the fault may come from a copyout() by readi() on this
+  // very inode, in which case its lock is already held. one
+  // by readi() or writei() on another inode, if a thread
+  // remapped the page after uvmprefault(), must fail.
+  ip = v->f->ip;
+  locked = holdingsleep(&ip->lock);
+  if(!locked && myproc()->nilock > 0)
+    return -1;
+
+  va = PGROUNDDOWN(va);
+  if((mem = kalloc_zeroed()) == 0)
+    return -1;
+
+  // the file keeps its reference while vmlock() is let go.
+  f = filedup(v->f);
+  off = v->off + (va - v->addr);
+  perm = protperm(v->prot);
+  vmunlock(p);
+  if(!locked)
+    ilock(ip);
+  r = readi(ip, 0, (uint64)mem, off, PGSIZE);
+  if(!locked)
+    iunlock(ip);
+  fileclose(f);
+  vmlock(p);
+  if(r < 0){
+    kfree(mem);
+    return -1;
+  }
+  // another thread may have unmapped it meanwhile.
+  if(vmalookup(p, va) != v || v->f != f){
+    kfree(mem);
+    return -1;
+  }
+  return vmfill(p->pagetable, va, mem, perm);
+}
+
+// Write the dirty pages of [addr, addr+len) in shared
+// mapping v back to its file. Never extends the file.
+static void
+mmapwriteback(struct proc *p, struct vma *v, uint64 addr, uint64 len)
+{
+  struct inode *ip = v->f->ip;
+  // as in filewrite(), stay within a log transaction.
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  uint64 a, pa, off;
+  pte_t *pte;
+  int n, done;
+
+  for(a = addr; a < addr + len; a += PGSIZE){
+    pte = walk(p->pagetable, a, 0);
+    if(pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_D) == 0)
+      continue;
+    pa = PTE2PA(*pte);
+    off = v->off + (a - v->addr);
+    for(done = 0; done < PGSIZE; done += n){
+      n = PGSIZE - done;
+      if(n > max)
+        n = max;
+      begin_op();
+      ilock(ip);
+      if(off + done >= ip->size)
+        n = 0;
+      else if(off + done + n > ip->size)
+        n = ip->size - (off + done);
+      if(n > 0)
+        writei(ip, 0, pa + done, off + done, n);
+      iunlock(ip);
+      end_op();
+      if(n == 0)
+        break;
+    }
+    *pte &= ~PTE_D;
+  }
+}
+
+// Unmap [addr, addr+len) of v, which must be at the start
+// or end of v, or all of it, without writing it back.
+static void
+vmaunmap(struct proc *p, struct vma *v, uint64 addr, uint64 len)
+{
+  uvmunmap(p->pagetable, addr, len / PGSIZE, 1);
+  asidflush(p);
+
+  if(addr == v->addr){
+    v->addr += len;
+    v->off += len;
+  }
+  v->len -= len;
+  if(v->len == 0){
+    fileclose(v->f);
+    v->f = 0;
+    v->used = 0;
+  }
+}
+
+// Write back and unmap all of p's mapped regions.
+// Called by exit() and exec(), when p has no threads.
+void
+mmapexit(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(!v->used)
+      continue;
+    if((v->flags & MAP_SHARED) && v->f->type == FD_INODE)
+      mmapwriteback(p, v, v->addr, v->len);
+    vmaunmap(p, v, v->addr, v->len);
+  }
+}
+
+// Give child np copies of p's mapped regions.
+// p is a main thread, and the caller holds vmlock(p).
+// Shared mappings share their pages with p; private
+// ones become copy-on-write, as with the heap.
+// Returns 0 on success, -1 on failure, leaving
+// np with no mapped pages.
+int
+mmapfork(struct proc *p, struct proc *np)
+{
+  int i, j;
+
+  for(i = 0; i < NVMA; i++){
+    struct vma *v = &p->vma[i];
+    if(v->used && uvmcopyrange(p->pagetable, np->pagetable, v->addr,
+                               v->addr + v->len, v->flags & MAP_SHARED) < 0){
+      for(j = 0; j < i; j++)
+        if(p->vma[j].used)
+          uvmunmap(np->pagetable, p->vma[j].addr, p->vma[j].len / PGSIZE, 1);
+      return -1;
+    }
+  }
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = p->vma[i];
+    if(np->vma[i].used)
+      filedup(np->vma[i].f);
+  }
+  return 0;
+}
+
+// Map len bytes of f starting at offset off into the current
+// process, at an address of the kernel's choosing.
+// Returns the address, or -1 on error.
+uint64
+mmap(struct file *f, uint64 len, int prot, int flags, uint64 off)
+{
+  struct proc *p = myproc();
+  struct proc *m = p->main;
+  struct vma *v, *free;
+  uint64 addr;
+
+  if(len == 0 || len > MMAPTOP || off % PGSIZE != 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if(f->type != FD_INODE && f->type != FD_SHM)
+    return -1;
+  if(f->type == FD_SHM && (flags != MAP_SHARED || (prot & (PROT_READ|PROT_WRITE|PROT_EXEC)) == 0))
+    return -1;
+  if((prot & (PROT_READ|PROT_EXEC)) && !f->readable)
+    return -1;
+  if((prot & PROT_WRITE) && flags == MAP_SHARED && !f->writable)
+    return -1;
+
+  vmlock(p);
+  free = 0;
+  for(v = m->vma; v < &m->vma[NVMA]; v++)
+    if(!v->used){
+      free = v;
+      break;
+    }
+  len = PGROUNDUP(len);
+  addr = mmapbase(m);
+  if(free == 0 || addr < len || addr - len < PGROUNDUP(m->sz)){
+    vmunlock(p);
+    return -1;
+  }
+  addr -= len;
+  if(f->type == FD_SHM && shmmap(p->pagetable, f->shm, addr, off, len, protperm(prot)) < 0){
+    vmunlock(p);
+    return -1;
+  }
+
+  v = free;
+  v->used = 1;
+  v->addr = addr;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->f = filedup(f);
+  v->off = off;
+  vmunlock(p);
+  return addr;
+}
+
+// Return the VMA of main thread p that [addr, addr+len)
+// can be unmapped from: one that it lies within, and
+// whose start or end it includes. Or return 0.
+static struct vma*
+vmarange(struct proc *p, uint64 addr, uint64 len)
+{
+  struct vma *v;
+
+  if((v = vmalookup(p, addr)) == 0 || addr + len > v->addr + v->len)
+    return 0;
+  if(addr != v->addr && addr + len != v->addr + v->len)
+    return 0;
+  return v;
+}
+
+// Unmap [addr, addr+len) from the current process.
+// The range must lie within one mapping and include
+// its start or its end. Returns 0, or -1 on error.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct proc *m = p->main;
+  struct vma *v, w;
+
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+  len = PGROUNDUP(len);
+  vmlock(p);
+  if((v = vmarange(m, addr, len)) == 0){
+    vmunlock(p);
+    return -1;
+  }
+  w = *v;
+  filedup(w.f);
+  vmunlock(p);
+
+  // write back from a copy of v, which another
+  // thread may change meanwhile.
+  if((w.flags & MAP_SHARED) && w.f->type == FD_INODE)
+    mmapwriteback(p, &w, addr, len);
+
+  vmlock(p);
+  if((v = vmarange(m, addr, len)) != 0 && v->f == w.f)
+    vmaunmap(p, v, addr, len);
+  vmunlock(p);
+  fileclose(w.f);
+  return 0;
+}
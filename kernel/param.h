@@ -9,5 +9,13 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       2000  // size of file system in blocks
+#define SWAPSIZE     32768 // blocks of swap space after the file system
+#define MAXORDER     10  // largest kalloc_pages() block is 2^MAXORDER pages
 #define MAXPATH      128   // maximum file path name
+#define NVMA         16  // memory-mapped regions per process
+#define NSEG         4   // loadable ELF segments per program
+#define NSPAWNACT    8   // max file actions per spawn()
+#define NPRIO        3   // run queue levels with make MLFQ=1
+#define NSHM         16  // shared memory segments per system
+#define SHMNAME      16  // max length of a segment's name, with its 0
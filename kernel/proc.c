@@ -3,8 +3,10 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
+#include "spawn.h"
 
 struct cpu cpus[NCPU];
 
@@ -17,6 +19,7 @@ struct spinlock pid_lock;
 
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void threadkill(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -26,6 +29,33 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// Sleeping processes, in a hash table of queues keyed by
+// channel, so that wakeup() looks only at the processes
+// sleeping on its channel, or on one that hashes the same.
+// A queue's lock is acquired after the lock passed to
+// sleep() and before any p->lock.
+#define WAITQBITS 6
+#define NWAITQ (1 << WAITQBITS)
+
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;    // oldest first, linked through p->waitnext
+  uint64 nwakeup;       // wakeup() calls
+  uint64 nscan;         // processes they looked at
+  uint64 nwoken;        // processes they made runnable
+} waitqs[NWAITQ];
+
+// A lock on each main thread's address space, which its
+// threads share; see vmlock().
+struct sleeplock vmlocks[NPROC];
+
+// Return chan's wait queue.
+static struct waitq*
+waitq(void *chan)
+{
+  return &waitqs[((uint64)chan * 0x9E3779B97F4A7C15L) >> (64 - WAITQBITS)];
+}
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -50,8 +80,12 @@ procinit(void)
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitqs[i].lock, "waitq");
+  runqinit();
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
+      initsleeplock(&vmlocks[p - proc], "vm");
       p->kstack = KSTACK((int) (p - proc));
   }
 }
@@ -99,10 +133,12 @@ allocpid() {
 
 // Look in the process table for an UNUSED proc.
 // If found, initialize state required to run in the kernel,
-// and return with p->lock held.
+// and return with p->lock held. It is a thread of main thread
+// m, using m's page table, or if m is 0 has a page table of
+// its own.
 // If there are no free procs, or a memory allocation fails, return 0.
 static struct proc*
-allocproc(void)
+allocproc(struct proc *m)
 {
   struct proc *p;
 
@@ -119,21 +155,42 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  p->prio = p->baseprio = p->slice = 0;
+  p->main = m ? m : p;
+
+  // nothing else touches a USED proc, so allocate without
+  // p->lock, letting kalloc() swap memory out if it must.
+  release(&p->lock);
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+    acquire(&p->lock);
     freeproc(p);
     release(&p->lock);
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
+  // An empty user page table, or m's, where clone() maps
+  // the trapframe; and the kernel page table to run the
+  // process's kernel code on.
+  if(m){
+    p->pagetable = m->pagetable;
+    p->tfva = THREADFRAME(p - proc);
+  } else {
+    p->pagetable = proc_pagetable(p);
+    p->tfva = TRAPFRAME;
+  }
+  if(p->pagetable == 0 || (p->kpagetable = kvmcreate(p->pagetable)) == 0){
+    acquire(&p->lock);
     freeproc(p);
     release(&p->lock);
     return 0;
   }
+  acquire(&p->lock);
+  if(m == 0){
+    asidalloc(p);
+    p->nthread = 1;
+  }
 
   // Set up new context to start executing at forkret,
   // which returns to user space.
@@ -153,10 +210,17 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
+  if(p->kpagetable)
+    kvmfree(p->kpagetable);
+  p->kpagetable = 0;
+  // a thread's page table belongs to its main thread.
+  if(p->pagetable && p->main == p)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
   p->sz = 0;
+  p->main = 0;
+  p->nthread = 0;
+  p->ustack = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
@@ -227,7 +291,7 @@ userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
   
   // allocate one user page and copy init's instructions
@@ -242,31 +306,56 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  p->cpu = runqpick();
+  setrunnable(p);
 
   release(&p->lock);
 }
 
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
+// Caller holds vmlock(), since threads share the memory.
 int
 growproc(int n)
 {
-  uint sz;
+  uint64 sz;
   struct proc *p = myproc();
+  struct proc *m = p->main;
 
-  sz = p->sz;
+  sz = m->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    // only reserve the address space; vmfault()
+    // allocates pages when they are first touched.
+    if(sz + n > mmapbase(m))
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
+    if(-(uint64)n > sz)
+      return -1;
     sz = uvmdealloc(p->pagetable, sz, sz + n);
+    asidflush(p);
+    segshrink(m, sz);
   }
-  p->sz = sz;
+  m->sz = sz;
   return 0;
 }
 
+// Lock p's address space against changes by the other
+// threads sharing it: their page faults, sbrk()s, mmap()s
+// and munmap()s. A sleep lock, since a page fault may have
+// to wait for memory or the disk.
+void
+vmlock(struct proc *p)
+{
+  acquiresleep(&vmlocks[p->main - proc]);
+}
+
+void
+vmunlock(struct proc *p)
+{
+  releasesleep(&vmlocks[p->main - proc]);
+}
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int
@@ -275,19 +364,31 @@ fork(void)
   int i, pid;
   struct proc *np;
   struct proc *p = myproc();
+  struct proc *m = p->main;
 
   // Allocate process.
-  if((np = allocproc()) == 0){
+  if((np = allocproc(0)) == 0){
     return -1;
   }
 
-  // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // Copy user memory from parent to child, and mapped files.
+  // Either may have made the parent's pages copy-on-write.
+  // np is only USED, so the lock can be let go meanwhile,
+  // letting kalloc() swap memory out for page-table pages.
+  release(&np->lock);
+  vmlock(p);
+  if(uvmcopy(p->pagetable, np->pagetable, m->sz) < 0 ||
+     mmapfork(m, np) < 0){
+    asidflush(p);
+    vmunlock(p);
+    acquire(&np->lock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
-  np->sz = p->sz;
+  asidflush(p);
+  np->sz = m->sz;
+  vmunlock(p);
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -296,23 +397,127 @@ fork(void)
   np->trapframe->a0 = 0;
 
   // increment reference counts on open file descriptors.
+  acquire(&m->lock);
   for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+    if(m->ofile[i])
+      np->ofile[i] = filedup(m->ofile[i]);
+  np->cwd = idup(m->cwd);
+  release(&m->lock);
+
+  // the child faults in untouched pages of the program too.
+  if(m->exip)
+    np->exip = idup(m->exip);
+  memmove(np->seg, m->seg, sizeof(m->seg));
+  np->nseg = m->nseg;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
 
+  acquire(&wait_lock);
+  np->parent = p;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->prio = np->baseprio = p->baseprio;
+  np->cpu = runqpick();
+  setrunnable(np);
   release(&np->lock);
 
+  return pid;
+}
+
+// Apply spawn()'s file actions to np's open files.
+static int
+spawnfiles(struct proc *np, struct spawnact *act, int nact)
+{
+  struct spawnact *a;
+  struct file *f;
+
+  for(a = act; a < &act[nact]; a++){
+    if(a->fd < 0 || a->fd >= NOFILE)
+      return -1;
+    f = 0;
+    switch(a->op){
+    case SPAWN_CLOSE:
+      break;
+    case SPAWN_DUP2:
+      if(a->arg < 0 || a->arg >= NOFILE || np->ofile[a->arg] == 0)
+        return -1;
+      f = filedup(np->ofile[a->arg]);
+      break;
+    case SPAWN_OPEN:
+      if((f = fileopen(a->path, a->arg)) == 0)
+        return -1;
+      break;
+    default:
+      return -1;
+    }
+    if(np->ofile[a->fd])
+      fileclose(np->ofile[a->fd]);
+    np->ofile[a->fd] = f;
+  }
+  return 0;
+}
+
+// Create a child running the program at path with argv, the
+// way fork() followed by exec() in the child would, but
+// building the child from the program file alone rather than
+// from a copy of the caller's memory. The child starts with
+// the caller's open files, changed by the nact actions in act,
+// and current directory. Returns the child's pid, or -1.
+int
+spawn(char *path, char **argv, struct spawnact *act, int nact)
+{
+  int i, pid, argc;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct proc *m = p->main;
+
+  if((np = allocproc(0)) == 0){
+    return -1;
+  }
+  // np stays USED, so nothing else looks at it while
+  // its files and image are set up, which may sleep.
+  release(&np->lock);
+
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  acquire(&m->lock);
+  for(i = 0; i < NOFILE; i++)
+    if(m->ofile[i])
+      np->ofile[i] = filedup(m->ofile[i]);
+  np->cwd = idup(m->cwd);
+  release(&m->lock);
+
+  if(spawnfiles(np, act, nact) < 0 ||
+     (argc = execproc(np, path, argv)) < 0){
+    for(i = 0; i < NOFILE; i++){
+      if(np->ofile[i]){
+        fileclose(np->ofile[i]);
+        np->ofile[i] = 0;
+      }
+    }
+    begin_op();
+    iput(np->cwd);
+    end_op();
+    np->cwd = 0;
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->trapframe->a0 = argc;
+
+  pid = np->pid;
+
   acquire(&wait_lock);
   np->parent = p;
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  np->prio = np->baseprio = p->baseprio;
+  np->cpu = runqpick();
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
@@ -335,7 +540,9 @@ reparent(struct proc *p)
 
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
-// until its parent calls wait().
+// until its parent calls wait(). A thread ends only
+// itself, and stays a zombie until join() or its main
+// thread's exit(); the main thread ends its threads too.
 void
 exit(int status)
 {
@@ -344,27 +551,49 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
+  if(p->main != p){
+    // the main thread's exit() frees what they share.
+    vmlock(p);
+    uvmunmap(p->pagetable, p->tfva, 1, 0);
+    vmunlock(p);
+    asidflush(p);
+  } else {
+    // the other threads use all that is freed here.
+    threadkill(p);
+
+    // Write back and unmap mapped files.
+    mmapexit(p);
+
+    // Close all open files.
+    for(int fd = 0; fd < NOFILE; fd++){
+      if(p->ofile[fd]){
+        struct file *f = p->ofile[fd];
+        fileclose(f);
+        p->ofile[fd] = 0;
+      }
     }
-  }
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
+    begin_op();
+    iput(p->cwd);
+    if(p->exip)
+      iput(p->exip);
+    end_op();
+    p->cwd = 0;
+    p->exip = 0;
+    p->nseg = 0;
+  }
 
   acquire(&wait_lock);
 
   // Give any children to init.
   reparent(p);
 
-  // Parent might be sleeping in wait().
-  wakeup(p->parent);
+  // Parent might be sleeping in wait(), or for a thread,
+  // another in join() or the main thread in threadkill().
+  if(p->main == p)
+    wakeup(p->parent);
+  else
+    wakeup(&p->main->nthread);
   
   acquire(&p->lock);
 
@@ -384,7 +613,7 @@ int
 wait(uint64 addr)
 {
   struct proc *np;
-  int havekids, pid;
+  int havekids, pid, xstate;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
@@ -401,15 +630,14 @@ wait(uint64 addr)
         if(np->state == ZOMBIE){
           // Found one.
           pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
+          xstate = np->xstate;
           freeproc(np);
           release(&np->lock);
           release(&wait_lock);
+          // copy out with no locks held, since a page fault may sleep.
+          if(addr != 0 && copyout(p->pagetable, addr, (char *)&xstate,
+                                  sizeof(xstate)) < 0)
+            return -1;
           return pid;
         }
         release(&np->lock);
@@ -427,10 +655,157 @@ wait(uint64 addr)
   }
 }
 
+// Create a thread of the current process: a process with its
+// own pid, trapframe and kernel stack, that shares the main
+// thread's page table, and so its memory, and its open files
+// and current directory. It starts at fn(arg), on the user
+// stack whose top is stack, and should end with exit(),
+// since fn has nowhere to return to. Returns its pid, or -1.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  int pid;
+  struct proc *np;
+  struct proc *p = myproc();
+  struct proc *m = p->main;
+
+  if(stack % 16 != 0)
+    return -1;
+  if((np = allocproc(m)) == 0){
+    return -1;
+  }
+  release(&np->lock);
+
+  // only np uses its trapframe's page, but it is
+  // mapped in the page table that all threads share.
+  vmlock(p);
+  if(mappages(m->pagetable, np->tfva, PGSIZE,
+              (uint64)np->trapframe, PTE_R | PTE_W) < 0){
+    vmunlock(p);
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  vmunlock(p);
+
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->sp = stack;
+  np->trapframe->a0 = arg;
+  np->trapframe->ra = 0;
+  np->ustack = stack;
+  safestrcpy(np->name, p->name, sizeof(p->name));
+  pid = np->pid;
+
+  // threadkill() marks every thread of m killed while
+  // holding wait_lock, np included, so np either counts
+  // among m's threads or is never started.
+  acquire(&wait_lock);
+  if(p->killed){
+    release(&wait_lock);
+    vmlock(p);
+    uvmunmap(m->pagetable, np->tfva, 1, 0);
+    vmunlock(p);
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  m->nthread++;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->prio = np->baseprio = p->baseprio;
+  np->cpu = runqpick();
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Wait for another thread of the current process to exit,
+// and return its pid, copying the stack it was cloned with
+// to addr if not 0. Return -1 if there are no others.
+int
+join(uint64 addr)
+{
+  struct proc *np;
+  int havethreads, pid;
+  uint64 stack;
+  struct proc *p = myproc();
+  struct proc *m = p->main;
+
+  acquire(&wait_lock);
+
+  for(;;){
+    havethreads = 0;
+    for(np = proc; np < &proc[NPROC]; np++){
+      if(np->main == m && np != m && np != p){
+        // make sure the thread isn't still in exit() or swtch().
+        acquire(&np->lock);
+
+        havethreads = 1;
+        if(np->state == ZOMBIE){
+          pid = np->pid;
+          stack = np->ustack;
+          freeproc(np);
+          m->nthread--;
+          release(&np->lock);
+          release(&wait_lock);
+          if(addr != 0 && copyout(p->pagetable, addr, (char *)&stack,
+                                  sizeof(stack)) < 0)
+            return -1;
+          return pid;
+        }
+        release(&np->lock);
+      }
+    }
+
+    if(!havethreads || p->killed){
+      release(&wait_lock);
+      return -1;
+    }
+
+    sleep(&m->nthread, &wait_lock);
+  }
+}
+
+// Kill the other threads of main thread p, and reap them,
+// before p exits.
+static void
+threadkill(struct proc *p)
+{
+  struct proc *np;
+
+  acquire(&wait_lock);
+  for(;;){
+    for(np = proc; np < &proc[NPROC]; np++){
+      if(np->main != p || np == p)
+        continue;
+      acquire(&np->lock);
+      if(np->state == ZOMBIE){
+        freeproc(np);
+        p->nthread--;
+      } else {
+        np->killed = 1;
+        if(np->state == SLEEPING)
+          setrunnable(np);
+      }
+      release(&np->lock);
+    }
+    if(p->nthread == 1)
+      break;
+    sleep(&p->nthread, &wait_lock);
+  }
+  release(&wait_lock);
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - choose a process to run, from this CPU's run queue
+//    or another's (see runq.c).
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -439,28 +814,42 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
   
   c->proc = 0;
+  runqstart(id);
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
+    if((p = runqget(id)) == 0){
+      // nothing to run; use the time to clear pages,
+      // or if there are none to clear, wait for work.
+      if(kzero_refill() == 0)
+        runqidle(id);
+      continue;
     }
+
+    // the hart that queued p may still be switching away
+    // from it, holding p->lock until it is done.
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler: queued proc not runnable");
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    c->proc = p;
+    clockrun();
+    kvmswitch(p);
+    swtch(&c->context, &p->context);
+    kvmswitch(0);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    c->proc = 0;
+    release(&p->lock);
   }
 }
 
@@ -497,7 +886,7 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -529,28 +918,46 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = waitq(chan);
+  struct proc **pp;
+  int queued;
   
+  // Once we hold chan's wait queue lock, we can be
+  // guaranteed that we won't miss any wakeup
+  // (wakeup locks it too), so it's okay to release lk.
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
 
+  acquire(&wq->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
-  // Go to sleep.
+  // Go to sleep, at the back of the queue, so that
+  // wakeupn() wakes those that have slept longest.
   p->chan = chan;
   p->state = SLEEPING;
+  for(pp = &wq->head; *pp; pp = &(*pp)->waitnext)
+    ;
+  p->waitnext = 0;
+  *pp = p;
+  release(&wq->lock);
 
   sched();
 
-  // Tidy up.
+  // Tidy up. wakeup() took p off the queue and
+  // cleared p->chan; kill() leaves both to us.
+  queued = p->chan != 0;
   p->chan = 0;
+  release(&p->lock);
+  if(queued){
+    acquire(&wq->lock);
+    for(pp = &wq->head; *pp != p; pp = &(*pp)->waitnext)
+      ;
+    *pp = p->waitnext;
+    release(&wq->lock);
+  }
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
@@ -559,17 +966,52 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  wakeupn(chan, NPROC);
+}
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
+// Wake up at most n of the processes sleeping on chan, those
+// that have slept longest, and return how many were woken.
+// Must be called without any p->lock.
+int
+wakeupn(void *chan, int n)
+{
+  struct waitq *wq = waitq(chan);
+  struct proc *p, **pp;
+  int woken = 0;
+
+  acquire(&wq->lock);
+  wq->nwakeup++;
+  for(pp = &wq->head; (p = *pp) != 0 && woken < n; ){
+    wq->nscan++;
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->chan == chan){
+      *pp = p->waitnext;
+      p->chan = 0;
+      setrunnable(p);
+      wq->nwoken++;
+      woken++;
+    } else {
+      pp = &p->waitnext;
     }
+    release(&p->lock);
+  }
+  release(&wq->lock);
+  return woken;
+}
+
+// Report wait queue use for the statistics device.
+int
+waitstats(char *buf, int sz)
+{
+  uint64 nwakeup = 0, nscan = 0, nwoken = 0;
+
+  for(struct waitq *wq = waitqs; wq < &waitqs[NWAITQ]; wq++){
+    nwakeup += wq->nwakeup;
+    nscan += wq->nscan;
+    nwoken += wq->nwoken;
   }
+  return snprintf(buf, sz, "wait: queues %d wakeup %l scan %l woken %l\n",
+                  NWAITQ, nwakeup, nscan, nwoken);
 }
 
 // Kill the process with the given pid.
@@ -586,7 +1028,7 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        setrunnable(p);
       }
       release(&p->lock);
       return 0;
@@ -596,6 +1038,50 @@ kill(int pid)
   return -1;
 }
 
+// Set the run queue level, from 0 to NPRIO-1, that process
+// pid starts at and returns to at each boost, and put it
+// there now. Only used with make MLFQ=1.
+int
+setpriority(int pid, int prio)
+{
+  struct proc *p;
+
+  if(prio < 0 || prio >= NPRIO)
+    return -1;
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid){
+      p->baseprio = prio;
+      p->prio = prio;
+      p->slice = 0;
+      runqmove(p);
+      release(&p->lock);
+      return 0;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
+// Return the current run queue level of process pid, or -1.
+int
+getpriority(int pid)
+{
+  struct proc *p;
+  int prio;
+
+  for(p = proc; p < &proc[NPROC]; p++){
+    acquire(&p->lock);
+    if(p->pid == pid){
+      prio = p->prio;
+      release(&p->lock);
+      return prio;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
+
 // Copy to either a user address, or kernel address,
 // depending on usr_dst.
 // Returns 0 on success, -1 on error.
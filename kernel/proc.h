@@ -24,6 +24,7 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 asidgen;             // ASID generation this hart's TLB is clean for.
 };
 
 extern struct cpu cpus[NCPU];
@@ -82,6 +83,29 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A region of user memory mapped by mmap().
+// Pages are read from the file when first touched.
+struct vma {
+  int used;
+  uint64 addr;        // page-aligned start
+  uint64 len;         // page-aligned length
+  int prot;           // PROT_ flags
+  int flags;          // MAP_SHARED or MAP_PRIVATE
+  struct file *f;     // mapped file, holding a reference
+  uint64 off;         // file offset of addr
+};
+
+// A loadable segment of the running program. exec() only
+// records it; pages are read from the program file when
+// first touched.
+struct seg {
+  uint64 va;          // page-aligned start
+  uint64 memsz;       // bytes of memory
+  uint64 off;         // file offset of va
+  uint64 filesz;      // bytes read from the file; the rest is zero
+  int perm;           // PTE_ bits to map its pages with
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -89,20 +113,49 @@ struct proc {
   // p->lock must be held when using these:
   enum procstate state;        // Process state
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *waitnext;       // Next on chan's wait queue; see sleep()
+  uint64 deadline;             // When to wake, if on a timer wheel; see clock.c
+  int wheel;                   // Hart whose timer wheel it is on, or -1
+  struct proc *tnext;          // Next on the wheel
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int prio;                    // Run queue level, 0 highest; see runq.c
+  int baseprio;                // Level it starts at and is boosted back to
+  int slice;                   // Ticks used at prio
+  uint boost;                  // Boost period prio was last reset in
+  int cpu;                     // Hart whose run queue it goes on
+  struct proc *rqnext;         // Next on that run queue; see runq.c
 
-  // wait_lock must be held when using this:
+  // wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  int nthread;                 // Threads of a main thread, itself included
 
   // these are private to the process, so p->lock need not be held.
+  struct proc *main;           // Main thread, whose memory it shares; see clone()
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
+  pagetable_t pagetable;       // User page table, the main thread's
+  pagetable_t kpagetable;      // Kernel page table, showing user memory too
+  int asid;                    // Address-space ID it runs with; see asidsatp()
+  int vmbusy;                  // Kernel holds pagetable's PTEs; see swapout()
+  int nilock;                  // Inode locks it holds; see mmapfault()
   struct trapframe *trapframe; // data page for trampoline.S
+  uint64 tfva;                 // Where trapframe is mapped in pagetable
+  uint64 ustack;               // Stack it was cloned with, for join()
+  struct file *fpin;           // File argfd() holds during a system call
   struct context context;      // swtch() here to run process
+  char name[16];               // Process name (debugging)
+
+  // only the main thread's are used, by all its threads.
+  // vmlock() protects sz, vma and seg while there are
+  // threads, and the main thread's p->lock ofile and cwd.
+  uint64 sz;                   // Size of process memory (bytes)
+  uint64 asidgen;              // Generation asid was allocated in
+  uint64 tlbstale;             // Harts that may hold stale entries for asid
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
-  char name[16];               // Process name (debugging)
+  struct vma vma[NVMA];        // Memory-mapped regions
+  struct inode *exip;          // Program file, for demand paging
+  struct seg seg[NSEG];        // Its loadable segments
+  int nseg;
 };
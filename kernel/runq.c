@@ -0,0 +1,355 @@
+//
+// Per-hart run queues.
+//
+// Each hart has a FIFO queue of RUNNABLE processes, and its
+// scheduler() runs them in turn, so choosing a process takes
+// one lock that other harts seldom touch rather than every
+// p->lock in proc[]. A process made runnable by yield(),
+// wakeup() or kill() goes back on the queue of the hart it
+// last ran on, whose caches may still hold its working set;
+// a new one from fork() or spawn() goes on the shortest
+// queue. A hart whose queue is empty steals the oldest
+// process from the queue of another.
+//
+// A hart with nothing to run and nothing else to do waits
+// in runqidle() for an interrupt, rather than spinning, and
+// one that queues work while a hart is idle wakes it with a
+// software interrupt through the CLINT: the idle hart itself,
+// if the work is for it, or else to steal it.
+//
+// A process is on a queue exactly when it is RUNNABLE. Once
+// runqget() has taken it off, no one else will run it, and
+// the scheduler acquires p->lock only to wait for the hart
+// that queued it to finish switching away from it.
+//
+// By default the queue is round robin: every timer interrupt
+// sends the running process to the back. Build with make
+// MLFQ=1 for a multi-level feedback queue instead. Each queue
+// then has NPRIO levels, and the scheduler takes the first
+// process at the highest level (0) that has one. A process
+// that uses up its quantum at a level, 1 << level ticks in
+// all, however many times it slept meanwhile, drops a level;
+// one that sleeps a lot keeps its level. Every BOOSTTICKS
+// ticks all processes go back to the level they started at,
+// p->baseprio, which setpriority() sets, so that CPU-bound
+// processes are not starved for good.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#ifdef MLFQ
+#define NLEVEL NPRIO
+#else
+#define NLEVEL 1
+#endif
+#define QUANTUM(prio) (1 << (prio))   // ticks a process gets at prio
+#define BOOSTTICKS 10                 // ticks between priority boosts
+
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NLEVEL];  // next to run at each level;
+  struct proc *tail[NLEVEL];  // linked through p->rqnext
+  int len;                    // processes at all levels
+  uint boost;                 // boost period the levels were merged in
+  int online;                 // its hart has started scheduling
+  int idle;                   // its hart is in runqidle()
+  uint64 nrun;                // processes taken off to run here
+  uint64 nsteal;              // of which were taken from other queues
+  uint64 nidle;               // times its hart waited for work
+  uint64 nwake;               // wakeups sent to its hart
+  uint64 idletime;            // time its hart waited, in mtime cycles
+} runqs[NCPU];
+
+void
+runqinit(void)
+{
+  for(struct runq *rq = runqs; rq < &runqs[NCPU]; rq++)
+    initlock(&rq->lock, "runq");
+}
+
+// Hart id is ready to run processes from its queue.
+void
+runqstart(int id)
+{
+  runqs[id].online = 1;
+}
+
+// Return the hart with the shortest run queue, for a new
+// process. A racy read is good enough to spread them out.
+int
+runqpick(void)
+{
+  int i, best;
+
+  best = 0;
+  for(i = 1; i < NCPU; i++)
+    if(runqs[i].online && runqs[i].len < runqs[best].len)
+      best = i;
+  return best;
+}
+
+#ifdef MLFQ
+// If a boost has come due since p's last, put p back at
+// its starting level with a fresh quantum.
+// Caller holds p->lock.
+static void
+boostcheck(struct proc *p)
+{
+  uint boost = tickcount() / BOOSTTICKS;
+
+  if(p->boost != boost){
+    p->boost = boost;
+    p->prio = p->baseprio;
+    p->slice = 0;
+  }
+}
+#endif
+
+// Send a software interrupt to hart id,
+// to end its wait in runqidle().
+static void
+wake(int id)
+{
+  runqs[id].nwake++;
+  *(uint32*)KCLINT_MSIP(id) = 1;
+}
+
+// Work was queued on hart id. If that hart is idle, wake it;
+// if it is busy, wake some idle hart to steal the work.
+static void
+kick(int id)
+{
+  int i;
+
+  // release() of the queue lock was a fence, so this read
+  // of idle comes after the work was queued; see runqidle().
+  if(runqs[id].idle){
+    wake(id);
+    return;
+  }
+  for(i = 1; i < NCPU; i++){
+    if(runqs[(id + i) % NCPU].idle){
+      wake((id + i) % NCPU);
+      return;
+    }
+  }
+}
+
+// Make p RUNNABLE, queued on hart p->cpu.
+// Caller holds p->lock.
+void
+setrunnable(struct proc *p)
+{
+  struct runq *rq = &runqs[p->cpu];
+  int l = 0;
+
+  if(!holding(&p->lock))
+    panic("setrunnable");
+#ifdef MLFQ
+  boostcheck(p);
+  l = p->prio;
+#endif
+  p->state = RUNNABLE;
+  acquire(&rq->lock);
+  p->rqnext = 0;
+  if(rq->tail[l])
+    rq->tail[l]->rqnext = p;
+  else
+    rq->head[l] = p;
+  rq->tail[l] = p;
+  rq->len++;
+  release(&rq->lock);
+  kick(p->cpu);
+}
+
+// p->prio has changed. If p is waiting on a run queue, move
+// it to the back of its new level there, rather than leave
+// it at the old level until it next runs.
+// Caller holds p->lock.
+void
+runqmove(struct proc *p)
+{
+#ifdef MLFQ
+  struct runq *rq;
+  struct proc **pp, *prev;
+  int l;
+
+  // p cannot be queued again without p->lock, so if it is
+  // not on the queue of the hart it was queued for, it has
+  // been taken off to run.
+  if(p->state != RUNNABLE)
+    return;
+  rq = &runqs[p->cpu];
+  acquire(&rq->lock);
+  // a boost may have merged it into another level.
+  for(l = 0; l < NLEVEL; l++){
+    prev = 0;
+    for(pp = &rq->head[l]; *pp; pp = &(*pp)->rqnext){
+      if(*pp != p){
+        prev = *pp;
+        continue;
+      }
+      *pp = p->rqnext;
+      if(rq->tail[l] == p)
+        rq->tail[l] = prev;
+      p->rqnext = 0;
+      if(rq->tail[p->prio])
+        rq->tail[p->prio]->rqnext = p;
+      else
+        rq->head[p->prio] = p;
+      rq->tail[p->prio] = p;
+      release(&rq->lock);
+      return;
+    }
+  }
+  release(&rq->lock);
+#endif
+}
+
+// Take the first process at the highest level of rq
+// that has one, or return 0.
+static struct proc*
+dequeue(struct runq *rq)
+{
+  struct proc *p;
+  int l;
+
+  // an unlocked look first, so that idle harts looking
+  // for work do not pull every queue's lock to and fro.
+  if(rq->len == 0)
+    return 0;
+  acquire(&rq->lock);
+#ifdef MLFQ
+  // a boost has come due: move everything to the top
+  // level, in order, behind what is already there.
+  if(rq->boost != tickcount() / BOOSTTICKS){
+    rq->boost = tickcount() / BOOSTTICKS;
+    for(l = 1; l < NLEVEL; l++){
+      if(rq->head[l] == 0)
+        continue;
+      if(rq->tail[0])
+        rq->tail[0]->rqnext = rq->head[l];
+      else
+        rq->head[0] = rq->head[l];
+      rq->tail[0] = rq->tail[l];
+      rq->head[l] = rq->tail[l] = 0;
+    }
+  }
+#endif
+  p = 0;
+  for(l = 0; l < NLEVEL; l++){
+    if((p = rq->head[l]) != 0){
+      rq->head[l] = p->rqnext;
+      if(rq->head[l] == 0)
+        rq->tail[l] = 0;
+      rq->len--;
+      break;
+    }
+  }
+  release(&rq->lock);
+  return p;
+}
+
+// Find a process for hart id to run: the next on its own
+// queue, or else one stolen from another hart's. Returns the
+// process, not locked and no longer on any queue, or 0.
+struct proc*
+runqget(int id)
+{
+  struct proc *p;
+  int i;
+
+  if((p = dequeue(&runqs[id])) == 0){
+    for(i = 1; i < NCPU; i++){
+      if((p = dequeue(&runqs[(id + i) % NCPU])) != 0){
+        runqs[id].nsteal++;
+        break;
+      }
+    }
+  }
+  if(p){
+    p->cpu = id;
+    runqs[id].nrun++;
+  }
+  return p;
+}
+
+// Hart id found nothing to run: wait until an interrupt,
+// from a device, the timer, or a hart that queued work.
+void
+runqidle(int id)
+{
+  struct runq *rq = &runqs[id];
+  uint64 t0;
+  int i;
+
+  // with interrupts off, an interrupt arriving between the
+  // check and the wfi still ends the wfi.
+  intr_off();
+  rq->idle = 1;
+  __sync_synchronize();
+  for(i = 0; i < NCPU; i++){
+    if(runqs[i].len > 0){
+      rq->idle = 0;
+      return;
+    }
+  }
+  t0 = r_time();
+  wfi();
+  rq->idletime += r_time() - t0;
+  rq->nidle++;
+  rq->idle = 0;
+}
+
+// A timer interrupt found p running on this hart: charge
+// it the tick, and return whether it should yield the CPU.
+// Called by usertrap() and kerneltrap().
+int
+timeslice(struct proc *p)
+{
+#ifdef MLFQ
+  struct runq *rq = &runqs[p->cpu];
+  int l, yield;
+
+  acquire(&p->lock);
+  boostcheck(p);
+  yield = 0;
+  if(++p->slice >= QUANTUM(p->prio)){
+    if(p->prio < NPRIO-1)
+      p->prio++;
+    p->slice = 0;
+    yield = 1;
+  }
+  // give way to anything waiting here at a higher level.
+  for(l = 0; l < p->prio && !yield; l++)
+    if(rq->head[l])
+      yield = 1;
+  release(&p->lock);
+  return yield;
+#else
+  return 1;
+#endif
+}
+
+// Report run queue lengths and counts for the statistics device.
+int
+runqstats(char *buf, int sz)
+{
+  int n = 0;
+
+  for(int i = 0; i < NCPU; i++){
+    struct runq *rq = &runqs[i];
+    if(!rq->online)
+      continue;
+    n += snprintf(buf+n, sz-n, "runq cpu %d: len %d run %l steal %l idle %l idlems %l wake %l\n",
+                  i, rq->len, rq->nrun, rq->nsteal, rq->nidle,
+                  rq->idletime / (MTIMEFREQ / 1000), rq->nwake);
+  }
+  return n;
+}
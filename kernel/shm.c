@@ -0,0 +1,244 @@
+//
+// Shared memory segments.
+//
+// shmopen() gives a file descriptor for a segment of zeroed
+// pages. A named segment can be opened by any process that
+// knows the name, until shmunlink() removes the name; one
+// made with no name is shared only by passing its descriptor
+// on, through fork() or spawn(). mmap() of the descriptor
+// maps the segment's own pages into the caller's page table,
+// so processes that map it exchange data without the kernel
+// copying anything.
+//
+// A segment lives as long as a file refers to it, or its
+// name does. A mapping holds a reference to its file, so
+// the segment outlives all mappings of it; each mapped page
+// also has a reference of its own, taken by mappages()'s
+// caller and dropped by uvmunmap(), which fork() and exit()
+// already look after for mmap()ed pages.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "fcntl.h"
+
+#define SHMMAXPG (PGSIZE / sizeof(char*))   // most pages in a segment
+
+struct shm {
+  int ref;              // files referring to it, plus one while named
+  char name[SHMNAME];   // empty if anonymous or unlinked
+  int npages;
+  char **pages;         // a page of pointers to its pages
+};
+
+struct {
+  struct spinlock lock;
+  struct shm shm[NSHM];
+  int npages;           // pages held by all segments
+} shmtable;
+
+void
+shminit(void)
+{
+  initlock(&shmtable.lock, "shm");
+}
+
+// Free a segment's pages. Its slot in shmtable is
+// already free again.
+static void
+shmfree(char **pages, int npages)
+{
+  for(int i = 0; i < npages; i++)
+    kfree(pages[i]);
+  kfree(pages);
+}
+
+// Allocate a list of npages zeroed pages.
+// Returns 0 if memory ran out.
+static char**
+shmalloc(int npages)
+{
+  char **pages;
+  int i;
+
+  if((pages = kalloc()) == 0)
+    return 0;
+  for(i = 0; i < npages; i++){
+    if((pages[i] = kalloc_zeroed()) == 0){
+      shmfree(pages, i);
+      return 0;
+    }
+  }
+  return pages;
+}
+
+// Return the named segment, or 0. Caller holds shmtable.lock.
+static struct shm*
+shmlookup(char *name)
+{
+  struct shm *s;
+
+  for(s = shmtable.shm; s < &shmtable.shm[NSHM]; s++)
+    if(s->ref > 0 && s->name[0] && strncmp(s->name, name, SHMNAME) == 0)
+      return s;
+  return 0;
+}
+
+// Open the segment called name, of at least size bytes,
+// creating it if it does not exist and omode has O_CREATE.
+// If name is 0, make a new anonymous segment. Returns a new
+// file for the segment, or 0.
+struct file*
+shmopen(char *name, uint64 size, int omode)
+{
+  struct shm *s;
+  struct file *f;
+  char **pages;
+  int npages;
+
+  npages = PGROUNDUP(size) / PGSIZE;
+  if(npages > SHMMAXPG || (name == 0 && npages == 0))
+    return 0;
+  if((f = filealloc()) == 0)
+    return 0;
+
+  // allocate the pages first, in case the segment is to
+  // be made, since kalloc() may sleep.
+  pages = 0;
+  if((omode & O_CREATE) || name == 0){
+    if((pages = shmalloc(npages)) == 0){
+      fileclose(f);
+      return 0;
+    }
+  }
+
+  acquire(&shmtable.lock);
+  if(name && (s = shmlookup(name)) != 0){
+    if(npages > s->npages)
+      goto bad;
+    s->ref++;
+  } else if(pages){
+    for(s = shmtable.shm; s < &shmtable.shm[NSHM]; s++)
+      if(s->ref == 0)
+        break;
+    if(s == &shmtable.shm[NSHM])
+      goto bad;
+    s->ref = 1;
+    s->name[0] = 0;
+    if(name){
+      safestrcpy(s->name, name, SHMNAME);
+      s->ref++;
+    }
+    s->npages = npages;
+    s->pages = pages;
+    shmtable.npages += npages;
+    pages = 0;
+  } else {
+    goto bad;
+  }
+  release(&shmtable.lock);
+
+  if(pages)
+    shmfree(pages, npages);   // someone else made it first
+  f->type = FD_SHM;
+  f->shm = s;
+  f->readable = !(omode & O_WRONLY);
+  f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  return f;
+
+ bad:
+  release(&shmtable.lock);
+  if(pages)
+    shmfree(pages, npages);
+  fileclose(f);
+  return 0;
+}
+
+// Drop a reference to s, freeing it if that was the last.
+static void
+shmput(struct shm *s)
+{
+  char **pages;
+  int npages;
+
+  acquire(&shmtable.lock);
+  if(--s->ref > 0){
+    release(&shmtable.lock);
+    return;
+  }
+  pages = s->pages;
+  npages = s->npages;
+  s->pages = 0;
+  s->npages = 0;
+  shmtable.npages -= npages;
+  release(&shmtable.lock);
+
+  shmfree(pages, npages);
+}
+
+// The last reference to a file for s was closed.
+void
+shmclose(struct shm *s)
+{
+  shmput(s);
+}
+
+// Remove a segment's name. It is freed once
+// nothing else refers to it. Returns 0, or -1.
+int
+shmunlink(char *name)
+{
+  struct shm *s;
+
+  acquire(&shmtable.lock);
+  if((s = shmlookup(name)) == 0){
+    release(&shmtable.lock);
+    return -1;
+  }
+  s->name[0] = 0;
+  release(&shmtable.lock);
+  shmput(s);
+  return 0;
+}
+
+// Map len bytes of s, starting off bytes in, at va in
+// pagetable with PTE permissions perm. Both off and len
+// are whole pages. Returns 0, or -1 with nothing mapped.
+int
+shmmap(pagetable_t pagetable, struct shm *s, uint64 va, uint64 off, uint64 len, int perm)
+{
+  uint64 a;
+  char *pa;
+
+  // the caller's file keeps s and its pages in place.
+  if(off > (uint64)s->npages * PGSIZE || len > (uint64)s->npages * PGSIZE - off)
+    return -1;
+  for(a = 0; a < len; a += PGSIZE){
+    pa = s->pages[(off + a) / PGSIZE];
+    krefinc(pa);
+    if(mappages(pagetable, va + a, PGSIZE, (uint64)pa, perm) != 0){
+      kfree(pa);
+      uvmunmap(pagetable, va, a / PGSIZE, 1);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Report shared memory use for the statistics device.
+int
+shmstats(char *buf, int sz)
+{
+  int n = 0;
+
+  for(struct shm *s = shmtable.shm; s < &shmtable.shm[NSHM]; s++)
+    if(s->ref > 0)
+      n++;
+  return snprintf(buf, sz, "shm: segments %d pages %d\n", n, shmtable.npages);
+}
@@ -0,0 +1,398 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of one fixed size, carved
+// out of whole pages ("slabs") taken from kalloc(). Each slab
+// starts with a struct slab header followed by as many objects
+// as fit, so an object's slab is found by rounding its address
+// down to a page boundary, and no object is ever page-aligned.
+//
+// In front of the slabs each CPU has a small magazine of free
+// objects, so that most allocations and frees touch only the
+// current CPU's magazine lock. A magazine that runs dry is
+// refilled with a batch from the slabs; one that overflows
+// returns half of its objects. A slab whose objects are all
+// free goes back to kalloc().
+//
+// kmalloc()/kmfree() allocate from a set of power-of-two size
+// classes, and fall back to whole pages above the largest.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NKCACHE 16   // maximum number of caches
+#define MAGSIZE 16   // objects per CPU magazine
+#define MAGBATCH (MAGSIZE/2)
+
+struct obj {
+  struct obj *next;
+};
+
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *next;       // on cache's partial list
+  struct slab *prev;
+  struct obj *free;        // free objects in this slab
+  int inuse;               // objects handed out of this slab
+};
+
+// objects start this far into a slab page.
+#define SLABHDR ((sizeof(struct slab) + 15) & ~15)
+
+struct magazine {
+  struct spinlock lock;
+  int n;                   // objects in objs[]
+  void *objs[MAGSIZE];
+  uint64 nalloc;           // kmem_cache_alloc() calls on this CPU
+  uint64 nfree;            // kmem_cache_free() calls on this CPU
+  uint64 nmiss;            // allocations that found objs[] empty
+};
+
+struct kmem_cache {
+  char *name;
+  uint size;               // object size, a multiple of 16
+  int perslab;             // objects per slab
+  struct spinlock lock;    // protects partial and the slabs
+  struct slab *partial;    // slabs with at least one free object
+  int nslab;               // slab pages allocated
+  int ninuse;              // objects out of the slabs
+  struct magazine mag[NCPU];
+};
+
+struct {
+  struct spinlock lock;
+  struct kmem_cache cache[NKCACHE];
+  int n;
+} kcache;
+
+// kmalloc() size classes.
+#define NKMALLOC 6
+static uint kmsize[NKMALLOC] = { 32, 64, 128, 256, 512, 1024 };
+static char *kmname[NKMALLOC] = {
+  "kmalloc-32", "kmalloc-64", "kmalloc-128",
+  "kmalloc-256", "kmalloc-512", "kmalloc-1024",
+};
+static struct kmem_cache *kmcache[NKMALLOC];
+
+void
+slabinit(void)
+{
+  initlock(&kcache.lock, "kcache");
+  for(int i = 0; i < NKMALLOC; i++)
+    kmcache[i] = kmem_cache_create(kmname[i], kmsize[i]);
+}
+
+// Create a cache of objects of the given size.
+// name must be a constant string. Panics if the table
+// is full or the objects would not fit in a slab.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+
+  size = (size + 15) & ~15;
+  if(size < sizeof(struct obj) || size > PGSIZE - SLABHDR)
+    panic("kmem_cache_create: size");
+
+  acquire(&kcache.lock);
+  if(kcache.n >= NKCACHE)
+    panic("kmem_cache_create: too many");
+  c = &kcache.cache[kcache.n];
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+  initlock(&c->lock, name);
+  c->partial = 0;
+  for(int i = 0; i < NCPU; i++)
+    initlock(&c->mag[i].lock, "kmag");
+  __sync_synchronize();
+  kcache.n++;
+  release(&kcache.lock);
+  return c;
+}
+
+static void
+partialpush(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+static void
+partialremove(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Add a fresh slab to c. kalloc() is called without
+// holding any cache lock, since it may reap caches.
+// Returns -1 if out of memory.
+static int
+slabgrow(struct kmem_cache *c)
+{
+  struct slab *s;
+  struct obj *o;
+  char *p;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return -1;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  p = (char*)s + SLABHDR;
+  for(int i = 0; i < c->perslab; i++){
+    o = (struct obj*)(p + i*c->size);
+    o->next = s->free;
+    s->free = o;
+  }
+
+  acquire(&c->lock);
+  partialpush(c, s);
+  c->nslab++;
+  release(&c->lock);
+  return 0;
+}
+
+// Take up to n objects out of c's slabs into objs[],
+// growing the cache if no slab has a free object.
+// Returns the number taken, 0 if out of memory.
+static int
+slabtake(struct kmem_cache *c, void **objs, int n)
+{
+  struct slab *s;
+  int got;
+
+  for(;;){
+    got = 0;
+    acquire(&c->lock);
+    while(got < n && (s = c->partial) != 0){
+      objs[got++] = s->free;
+      s->free = s->free->next;
+      s->inuse++;
+      if(s->free == 0)
+        partialremove(c, s);
+    }
+    c->ninuse += got;
+    release(&c->lock);
+    if(got > 0 || slabgrow(c) < 0)
+      return got;
+  }
+}
+
+// Return n objects to their slabs, and
+// the pages of slabs left empty to kalloc().
+// Returns the number of pages freed.
+static int
+slabput(struct kmem_cache *c, void **objs, int n)
+{
+  struct slab *s, *empty;
+  struct obj *o;
+  int npage;
+
+  empty = 0;
+  acquire(&c->lock);
+  for(int i = 0; i < n; i++){
+    o = (struct obj*)objs[i];
+    s = (struct slab*)PGROUNDDOWN((uint64)o);
+    if(s->free == 0)
+      partialpush(c, s);
+    o->next = s->free;
+    s->free = o;
+    if(--s->inuse == 0){
+      partialremove(c, s);
+      s->next = empty;
+      empty = s;
+      c->nslab--;
+    }
+  }
+  c->ninuse -= n;
+  release(&c->lock);
+
+  npage = 0;
+  while((s = empty) != 0){
+    empty = s->next;
+    kfree(s);
+    npage++;
+  }
+  return npage;
+}
+
+static struct magazine*
+mymag(struct kmem_cache *c)
+{
+  int id;
+
+  push_off();
+  id = cpuid();
+  pop_off();
+  return &c->mag[id];
+}
+
+// Allocate one object from c.
+// Returns 0 if memory cannot be allocated.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *obj, *objs[MAGBATCH];
+  int n;
+
+  m = mymag(c);
+  acquire(&m->lock);
+  m->nalloc++;
+  if(m->n > 0){
+    obj = m->objs[--m->n];
+    release(&m->lock);
+    return obj;
+  }
+  m->nmiss++;
+  release(&m->lock);
+
+  // refill the magazine with a batch from the slabs.
+  if((n = slabtake(c, objs, MAGBATCH)) == 0)
+    return 0;
+  obj = objs[--n];
+  acquire(&m->lock);
+  while(n > 0 && m->n < MAGSIZE)
+    m->objs[m->n++] = objs[--n];
+  release(&m->lock);
+  if(n > 0)
+    slabput(c, objs, n);
+  return obj;
+}
+
+// Free an object allocated by kmem_cache_alloc(c).
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct magazine *m;
+  void *objs[MAGBATCH];
+  int n;
+
+  if((uint64)obj % PGSIZE == 0 ||
+     ((struct slab*)PGROUNDDOWN((uint64)obj))->cache != c)
+    panic("kmem_cache_free");
+
+#ifdef JUNKFILL
+  // Fill with junk to catch dangling refs.
+  memset(obj, 1, c->size);
+#endif
+
+  n = 0;
+  m = mymag(c);
+  acquire(&m->lock);
+  m->nfree++;
+  if(m->n == MAGSIZE){
+    // full: send the older half back to the slabs.
+    for(; n < MAGBATCH; n++)
+      objs[n] = m->objs[n];
+    for(int i = MAGBATCH; i < MAGSIZE; i++)
+      m->objs[i - MAGBATCH] = m->objs[i];
+    m->n -= MAGBATCH;
+  }
+  m->objs[m->n++] = obj;
+  release(&m->lock);
+  if(n > 0)
+    slabput(c, objs, n);
+}
+
+// Empty every CPU's magazines back into the slabs, so that
+// slabs left with no objects in use are freed. Called by
+// kalloc() when it runs out of memory; must not be called
+// with any cache or magazine lock held.
+// Returns the number of pages freed.
+int
+kmem_cache_reap(void)
+{
+  struct kmem_cache *c;
+  struct magazine *m;
+  void *objs[MAGSIZE];
+  int i, j, n, ncache, npage;
+
+  ncache = kcache.n;
+  __sync_synchronize();
+  npage = 0;
+  for(i = 0; i < ncache; i++){
+    c = &kcache.cache[i];
+    for(j = 0; j < NCPU; j++){
+      m = &c->mag[j];
+      acquire(&m->lock);
+      n = m->n;
+      for(int k = 0; k < n; k++)
+        objs[k] = m->objs[k];
+      m->n = 0;
+      release(&m->lock);
+      if(n > 0)
+        npage += slabput(c, objs, n);
+    }
+  }
+  return npage;
+}
+
+// Allocate n bytes from the smallest size class that fits,
+// or a whole page if n is larger than the largest class.
+// Returns 0 if the memory cannot be allocated.
+void*
+kmalloc(uint n)
+{
+  for(int i = 0; i < NKMALLOC; i++)
+    if(n <= kmsize[i])
+      return kmem_cache_alloc(kmcache[i]);
+  if(n <= PGSIZE)
+    return kalloc();
+  return 0;
+}
+
+// Free memory returned by kmalloc().
+void
+kmfree(void *p)
+{
+  if((uint64)p % PGSIZE == 0)
+    kfree(p);
+  else
+    kmem_cache_free(((struct slab*)PGROUNDDOWN((uint64)p))->cache, p);
+}
+
+// Report each cache's size and usage for the statistics device.
+// "inuse" counts objects held by callers, "cached" objects
+// sitting in magazines.
+int
+slabstats(char *buf, int sz)
+{
+  struct kmem_cache *c;
+  struct magazine *m;
+  uint64 nalloc, nfree, nmiss;
+  int i, j, n, ncached;
+
+  n = 0;
+  for(i = 0; i < kcache.n; i++){
+    c = &kcache.cache[i];
+    nalloc = nfree = nmiss = 0;
+    ncached = 0;
+    for(j = 0; j < NCPU; j++){
+      m = &c->mag[j];
+      acquire(&m->lock);
+      ncached += m->n;
+      nalloc += m->nalloc;
+      nfree += m->nfree;
+      nmiss += m->nmiss;
+      release(&m->lock);
+    }
+    n += snprintf(buf+n, sz-n,
+                  "slab %s: size %d slabs %d inuse %d cached %d alloc %l free %l miss %l\n",
+                  c->name, c->size, c->nslab, c->ninuse - ncached, ncached,
+                  nalloc, nfree, nmiss);
+  }
+  return n;
+}
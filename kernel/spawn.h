@@ -0,0 +1,12 @@
+// File actions for spawn(), applied in order to the
+// child's copy of the caller's open files.
+#define SPAWN_CLOSE 1   // close fd
+#define SPAWN_DUP2  2   // make fd a copy of descriptor arg
+#define SPAWN_OPEN  3   // open path with mode arg as fd
+
+struct spawnact {
+  int op;
+  int fd;       // the child's descriptor to set
+  int arg;
+  char *path;   // for SPAWN_OPEN
+};
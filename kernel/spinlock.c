@@ -1,4 +1,23 @@
 // Mutual exclusion spin locks.
+//
+// A lock is test-and-set by default: waiters spin reading
+// locked, and try the atomic swap only when it looks free, so
+// that they do not keep pulling its cache line away from the
+// holder. One made with initticketlock() is a ticket lock
+// instead: each waiter takes the next ticket, and the lock
+// goes to tickets in order, which is fair however many harts
+// want it, and on release only the next in line sees a change
+// it can act on. Locks that many harts contend for, such as
+// the kalloc() free lists and the buffer cache, are ticket
+// locks; the others are cheaper as test-and-set.
+//
+// Every lock counts its acquires, those that had to wait, and
+// the loops spent waiting, which lockstat() copies out to find
+// the hottest locks. The counters are updated by the holder,
+// so they need no atomics. initlock() puts each lock on a list
+// of all locks for lockstat(); a lock in memory that is freed
+// must be taken off it with freelock().
+//
 
 #include "types.h"
 #include "param.h"
@@ -6,14 +25,59 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "proc.h"
+#include "lockstat.h"
 #include "defs.h"
 
+// All the locks initlock() has set up, for lockstat().
+// The list's own lock is not on it.
+static struct {
+  struct spinlock lock;
+  struct spinlock *head;
+  int n;
+} locks;
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->isticket = 0;
+  lk->ticket = lk->serving = 0;
+  lk->nacquire = lk->ncontend = lk->nspin = 0;
+
+  acquire(&locks.lock);
+  lk->prev = 0;
+  lk->next = locks.head;
+  if(locks.head)
+    locks.head->prev = lk;
+  locks.head = lk;
+  locks.n++;
+  release(&locks.lock);
+}
+
+// Like initlock(), but for a ticket lock.
+void
+initticketlock(struct spinlock *lk, char *name)
+{
+  initlock(lk, name);
+  lk->isticket = 1;
+}
+
+// Take lk, whose memory is about to be freed,
+// off the list of locks.
+void
+freelock(struct spinlock *lk)
+{
+  acquire(&locks.lock);
+  if(lk->prev)
+    lk->prev->next = lk->next;
+  else
+    locks.head = lk->next;
+  if(lk->next)
+    lk->next->prev = lk->prev;
+  locks.n--;
+  release(&locks.lock);
 }
 
 // Acquire the lock.
@@ -21,16 +85,31 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint64 nspin = 0;
+  uint t;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  if(lk->isticket){
+    // On RISC-V, this is an atomic add:
+    //   amoadd.w a5, a4, (s1)
+    t = __sync_fetch_and_add(&lk->ticket, 1);
+    while(__atomic_load_n(&lk->serving, __ATOMIC_RELAXED) != t)
+      nspin++;
+    lk->locked = 1;
+  } else {
+    // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
+    //   a5 = 1
+    //   s1 = &lk->locked
+    //   amoswap.w.aq a5, a5, (s1)
+    while(__sync_lock_test_and_set(&lk->locked, 1) != 0){
+      while(__atomic_load_n(&lk->locked, __ATOMIC_RELAXED) != 0)
+        nspin++;
+      nspin++;
+    }
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +119,11 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  lk->nacquire++;
+  if(nspin){
+    lk->ncontend++;
+    lk->nspin += nspin;
+  }
 }
 
 // Release the lock.
@@ -59,6 +143,15 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
+  if(lk->isticket){
+    // only the holder writes serving, so a store of the next
+    // ticket will do; the fence above orders it.
+    lk->locked = 0;
+    __atomic_store_n(&lk->serving, lk->serving + 1, __ATOMIC_RELEASE);
+    pop_off();
+    return;
+  }
+
   // Release the lock, equivalent to lk->locked = 0.
   // This code doesn't use a C assignment, since the C standard
   // implies that an assignment might be implemented with
@@ -108,3 +201,38 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// Copy the counters of up to n locks to user address addr,
+// an array of struct lockstat, and return how many there
+// are in all, or -1. The list may change meanwhile, as
+// pipes come and go, so a copy is not quite a snapshot.
+int
+lockstat(uint64 addr, int n)
+{
+  struct lockstat ls;
+  struct spinlock *lk;
+  int i, j, total;
+
+  for(i = 0; i < n; i++){
+    acquire(&locks.lock);
+    for(j = 0, lk = locks.head; j < i && lk; j++)
+      lk = lk->next;
+    if(lk == 0){
+      release(&locks.lock);
+      break;
+    }
+    safestrcpy(ls.name, lk->name, LOCKNAME);
+    ls.isticket = lk->isticket;
+    ls.nacquire = lk->nacquire;
+    ls.ncontend = lk->ncontend;
+    ls.nspin = lk->nspin;
+    release(&locks.lock);
+    // copy out with no locks held, since a page fault may sleep.
+    if(copyout(myproc()->pagetable, addr + i*sizeof(ls), (char*)&ls, sizeof(ls)) < 0)
+      return -1;
+  }
+  acquire(&locks.lock);
+  total = locks.n;
+  release(&locks.lock);
+  return total;
+}
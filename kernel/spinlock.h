@@ -2,8 +2,18 @@
 struct spinlock {
   uint locked;       // Is the lock held?
 
+  // For a ticket lock; see initticketlock().
+  uint isticket;     // Is it a ticket lock?
+  uint ticket;       // Next ticket to hand out.
+  uint serving;      // Ticket of the holder.
+
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
-};
 
+  // For lockstat():
+  uint64 nacquire;   // Times acquired.
+  uint64 ncontend;   // Of which it was held by another cpu.
+  uint64 nspin;      // Loops spent waiting for it.
+  struct spinlock *prev, *next;  // In the list of all locks.
+};
@@ -0,0 +1,105 @@
+//
+// formatted output into a kernel buffer -- snprintf.
+//
+
+#include <stdarg.h>
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "defs.h"
+
+static char digits[] = "0123456789abcdef";
+
+// Append c to buf if there is room.
+// Returns the number of bytes written (0 or 1).
+static int
+sputc(char *buf, int off, int sz, char c)
+{
+  if(off >= sz)
+    return 0;
+  buf[off] = c;
+  return 1;
+}
+
+static int
+sprintint(char *buf, int off, int sz, uint64 x, int base, int neg)
+{
+  char tmp[24];
+  int i, n;
+
+  i = 0;
+  do {
+    tmp[i++] = digits[x % base];
+  } while((x /= base) != 0);
+
+  if(neg)
+    tmp[i++] = '-';
+
+  n = 0;
+  while(--i >= 0)
+    n += sputc(buf, off+n, sz, tmp[i]);
+  return n;
+}
+
+// Format into buf, writing at most sz bytes. The result is
+// not nul-terminated. Returns the number of bytes written.
+// Only understands %d, %l (uint64), %x, %p, %s.
+int
+snprintf(char *buf, int sz, char *fmt, ...)
+{
+  va_list ap;
+  int i, c, d, off;
+  char *s;
+
+  if(fmt == 0)
+    panic("null fmt");
+
+  off = 0;
+  va_start(ap, fmt);
+  for(i = 0; off < sz && (c = fmt[i] & 0xff) != 0; i++){
+    if(c != '%'){
+      off += sputc(buf, off, sz, c);
+      continue;
+    }
+    c = fmt[++i] & 0xff;
+    if(c == 0)
+      break;
+    switch(c){
+    case 'd':
+      d = va_arg(ap, int);
+      if(d < 0)
+        off += sprintint(buf, off, sz, -(uint64)d, 10, 1);
+      else
+        off += sprintint(buf, off, sz, d, 10, 0);
+      break;
+    case 'l':
+      off += sprintint(buf, off, sz, va_arg(ap, uint64), 10, 0);
+      break;
+    case 'x':
+      off += sprintint(buf, off, sz, va_arg(ap, uint), 16, 0);
+      break;
+    case 'p':
+      off += sputc(buf, off, sz, '0');
+      off += sputc(buf, off, sz, 'x');
+      off += sprintint(buf, off, sz, va_arg(ap, uint64), 16, 0);
+      break;
+    case 's':
+      if((s = va_arg(ap, char*)) == 0)
+        s = "(null)";
+      for(; *s && off < sz; s++)
+        off += sputc(buf, off, sz, *s);
+      break;
+    case '%':
+      off += sputc(buf, off, sz, '%');
+      break;
+    default:
+      // Print unknown % sequence to draw attention.
+      off += sputc(buf, off, sz, '%');
+      off += sputc(buf, off, sz, c);
+      break;
+    }
+  }
+  va_end(ap);
+  return off;
+}
@@ -0,0 +1,96 @@
+//
+// The statistics device. Reading it returns a text snapshot
+// of kernel counters, one subsystem after another.
+// init creates /statistics; user/stats.c prints it.
+//
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define BUFSZ 4096
+
+static struct {
+  struct sleeplock lock; // held across copyout, which may sleep
+  char buf[BUFSZ];
+  int sz;   // bytes in the current snapshot
+  int off;  // how far readers have got into it
+} stats;
+
+// Each function appends its subsystem's counters to buf,
+// writing at most sz bytes, and returns the number written.
+static int (*statsfns[])(char*, int) = {
+  bootstats,
+  kallocstats,
+  kvmstats,
+  buddystats,
+  slabstats,
+  textstats,
+  asidstats,
+  swapstats,
+  shmstats,
+  runqstats,
+  waitstats,
+  clockstats,
+  futexstats,
+};
+
+static int
+statssnapshot(char *buf, int sz)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < NELEM(statsfns); i++)
+    n += statsfns[i](buf+n, sz-n);
+  return n;
+}
+
+int
+statswrite(int user_src, uint64 src, int n)
+{
+  return -1;
+}
+
+// Take a fresh snapshot at the start of each pass,
+// hand it out in pieces, then return 0 once.
+int
+statsread(int user_dst, uint64 dst, int n)
+{
+  int m;
+
+  acquiresleep(&stats.lock);
+
+  if(stats.sz == 0)
+    stats.sz = statssnapshot(stats.buf, BUFSZ);
+  m = stats.sz - stats.off;
+
+  if(m > 0){
+    if(m > n)
+      m = n;
+    if(either_copyout(user_dst, dst, stats.buf+stats.off, m) == -1)
+      m = -1;
+    else
+      stats.off += m;
+  } else {
+    stats.sz = 0;
+    stats.off = 0;
+    m = 0;
+  }
+  releasesleep(&stats.lock);
+  return m;
+}
+
+void
+statsinit(void)
+{
+  initsleeplock(&stats.lock, "stats");
+
+  devsw[STATS].read = statsread;
+  devsw[STATS].write = statswrite;
+}
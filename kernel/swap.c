@@ -0,0 +1,323 @@
+//
+// Swap space, for running processes whose memory adds up to
+// more than RAM.
+//
+// mkfs reserves sb.nswap blocks after the file system, which
+// are divided into page-sized slots. When kalloc() runs out,
+// swapout() picks pages of process memory with the clock
+// algorithm, writes each to a free slot, replaces its PTE with
+// a PTE_SWAP one naming the slot, and frees the page. A later
+// touch of the page faults, and vmfault() calls swapin() to
+// read it back. fork() shares slots the way it shares pages,
+// so each slot has a count of the PTEs that refer to it.
+//
+// Only anonymous memory below p->sz is swapped: heap, stack
+// and program data. Program text is shared through the text
+// cache, and mmap()ed pages are written back to their files.
+//
+// swapout() changes a process's page table while the process
+// is not running, holding its p->lock so that it cannot be
+// scheduled, or while the process is the caller. Kernel code
+// that keeps the physical address from one of its own PTEs
+// across something that may sleep raises p->vmbusy, which
+// keeps swapout() away from it; so does kerneltrap() for a
+// process preempted in the kernel.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "fs.h"
+#include "buf.h"
+#include "defs.h"
+
+#define BPP (PGSIZE / BSIZE)      // blocks per slot
+#define NSLOT (SWAPSIZE / BPP)    // most slots the kernel can track
+#define SWAPBATCH 16              // most pages swapout() writes per call
+
+extern struct proc proc[NPROC];
+
+struct {
+  struct spinlock lock;
+  int dev;
+  uint start;           // first swap block
+  int nslot;            // slots on the disk
+  short ref[NSLOT];     // PTEs naming each slot; 0 if free
+  int next;             // where to look for a free slot
+  int nused;
+  // the page being written out, which swapin()
+  // takes back rather than reading the slot.
+  int wslot;
+  char *wpage;
+
+  // evict is held by the one process running swapout(),
+  // and protects the clock hand.
+  struct sleeplock evict;
+  int hand;             // index in proc[]
+  uint64 handva;        // next page of proc[hand] to look at
+
+  struct sleeplock io;  // protects buf
+  struct buf buf;
+
+  uint64 nout;          // pages written out
+  uint64 nin;           // pages read in
+  uint64 nrescue;       // pages swapped in while still being written
+  uint64 nscan;         // PTEs examined by the clock
+} swap;
+
+// Find the swap area. Called by fsinit() once the
+// superblock has been read; until then there is none.
+void
+swapinit(int dev, struct superblock *sb)
+{
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swap.evict, "swapevict");
+  initsleeplock(&swap.io, "swapio");
+  swap.dev = dev;
+  swap.start = sb->swapstart;
+  swap.wslot = -1;
+  swap.nslot = sb->nswap / BPP;
+  if(swap.nslot > NSLOT)
+    swap.nslot = NSLOT;
+}
+
+// Read or write the page at pa from or to slot.
+static void
+swaprw(int slot, char *pa, int write)
+{
+  struct buf *b = &swap.buf;
+
+  acquiresleep(&swap.io);
+  for(int i = 0; i < BPP; i++){
+    b->dev = swap.dev;
+    b->blockno = swap.start + slot*BPP + i;
+    if(write)
+      memmove(b->data, pa + i*BSIZE, BSIZE);
+    virtio_disk_rw(b, write);
+    if(!write)
+      memmove(pa + i*BSIZE, b->data, BSIZE);
+  }
+  releasesleep(&swap.io);
+}
+
+// Allocate a slot, with one reference.
+// Returns -1 if swap is full.
+static int
+slotalloc(void)
+{
+  int i, slot;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    slot = (swap.next + i) % swap.nslot;
+    if(swap.ref[slot] == 0){
+      swap.ref[slot] = 1;
+      swap.next = (slot + 1) % swap.nslot;
+      swap.nused++;
+      release(&swap.lock);
+      return slot;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Another PTE refers to slot, copied by fork().
+void
+swapdup(int slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || swap.ref[slot] <= 0)
+    panic("swapdup");
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// A PTE referring to slot is gone.
+void
+swapfree(int slot)
+{
+  acquire(&swap.lock);
+  if(slot >= swap.nslot || swap.ref[slot] <= 0)
+    panic("swapfree");
+  if(--swap.ref[slot] == 0)
+    swap.nused--;
+  release(&swap.lock);
+}
+
+// May swapout() change p's page table? Caller holds p->lock.
+// Not if p has threads, which might be using it on other
+// harts; the racy read of nthread is safe, since only p
+// itself could clone meanwhile.
+static int
+swappable(struct proc *p)
+{
+  if(p->pagetable == 0 || p->vmbusy)
+    return 0;
+  if(p->main != p || p->nthread > 1)
+    return 0;
+  if(p == myproc())
+    return 1;
+  return p->state == SLEEPING || p->state == RUNNABLE;
+}
+
+// p's PTEs were changed: make sure no hart goes on using
+// translations it cached from them. Caller holds p->lock.
+static void
+swapflush(struct proc *p)
+{
+  if(p == myproc())
+    asidflush(p);
+  else
+    asidstale(p);
+}
+
+// Go round the pages of process memory looking for one to
+// write out. A page whose accessed bit is set has it cleared
+// and is passed over, to be taken next time round if it has
+// not been touched since. Returns the page, whose PTE now
+// names the slot in *slotp, or 0 if none could be found.
+// Caller holds swap.evict.
+static char*
+victim(int *slotp)
+{
+  struct proc *p;
+  pte_t *pte;
+  uint64 va;
+  char *pa;
+  int n, slot, cleared;
+
+  // each process is visited twice, to clear accessed
+  // bits and then to find them still clear.
+  for(n = 0; n < 2*NPROC + 1; n++){
+    p = &proc[swap.hand];
+    acquire(&p->lock);
+    cleared = 0;
+    for(va = swap.handva; swappable(p) && va < p->sz; va += PGSIZE){
+      if((pte = walk(p->pagetable, va, 0)) == 0){
+        // no level-0 page table: skip to the next one.
+        va = (va & ~(MEGAPGSIZE - 1)) + MEGAPGSIZE - PGSIZE;
+        continue;
+      }
+      swap.nscan++;
+      if((*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U) || (*pte & (PTE_W|PTE_COW)) == 0)
+        continue;
+      pa = (char*)PTE2PA(*pte);
+      if(krefcnt(pa) != 1)
+        continue;   // shared with another process
+      if(*pte & PTE_A){
+        *pte &= ~PTE_A;
+        cleared = 1;
+        continue;
+      }
+      if((slot = slotalloc()) < 0)
+        break;
+      *pte = SLOT2PTE(slot) | PTE_SWAP | (PTE_FLAGS(*pte) & (PTE_R|PTE_W|PTE_X|PTE_U|PTE_COW));
+      swapflush(p);
+      release(&p->lock);
+      swap.handva = va + PGSIZE;
+      *slotp = slot;
+      return pa;
+    }
+    if(cleared)
+      swapflush(p);
+    release(&p->lock);
+    if(swap.nused == swap.nslot)
+      return 0;
+    swap.hand = (swap.hand + 1) % NPROC;
+    swap.handva = 0;
+  }
+  return 0;
+}
+
+// Write some process memory out to swap, to free pages.
+// Called by kalloc() when it has run out. Does nothing if
+// the caller may not sleep: it holds a spinlock, or is not
+// a process. Returns the number of pages freed.
+int
+swapout(void)
+{
+  char *pa;
+  int n, slot;
+
+  if(swap.nslot == 0 || !intr_get() || myproc() == 0)
+    return 0;
+
+  acquiresleep(&swap.evict);
+  for(n = 0; n < SWAPBATCH; n++){
+    if((pa = victim(&slot)) == 0)
+      break;
+    acquire(&swap.lock);
+    swap.wslot = slot;
+    swap.wpage = pa;
+    release(&swap.lock);
+
+    swaprw(slot, pa, 1);
+
+    acquire(&swap.lock);
+    swap.wslot = -1;
+    swap.wpage = 0;
+    swap.nout++;
+    release(&swap.lock);
+    kfree(pa);
+  }
+  releasesleep(&swap.evict);
+  return n;
+}
+
+// Read back the page that pte, a PTE_SWAP PTE, refers to,
+// and map it with pte. Called by vmfault(). Returns 0, or
+// -1 if out of memory.
+int
+swapin(pte_t *pte)
+{
+  int slot = PTE2SLOT(*pte);
+  int perm = PTE_FLAGS(*pte) & ~PTE_SWAP;
+  char *mem, *page;
+  int shared;
+
+  // a page still being written out can be used as it is,
+  // unless a fork() since means other PTEs need it too.
+  acquire(&swap.lock);
+  page = 0;
+  shared = swap.ref[slot] > 1;
+  if(slot == swap.wslot){
+    page = swap.wpage;
+    krefinc(page);
+    swap.nrescue++;
+  }
+  swap.nin++;
+  release(&swap.lock);
+
+  if(page && !shared){
+    mem = page;
+  } else {
+    if((mem = kalloc()) == 0){
+      if(page)
+        kfree(page);
+      return -1;
+    }
+    if(page){
+      memmove(mem, page, PGSIZE);
+      kfree(page);
+    } else {
+      swaprw(slot, mem, 0);
+    }
+  }
+
+  *pte = PA2PTE(mem) | perm | PTE_V;
+  swapfree(slot);
+  return 0;
+}
+
+// Report swap use for the statistics device.
+int
+swapstats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "swap: slots %d used %d out %l in %l rescue %l scan %l\n",
+                  swap.nslot, swap.nused, swap.nout, swap.nin, swap.nrescue, swap.nscan);
+}
@@ -20,3 +20,17 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_mmap   22
+#define SYS_munmap 23
+#define SYS_spawn  24
+#define SYS_shmopen 25
+#define SYS_shmunlink 26
+#define SYS_setpriority 27
+#define SYS_getpriority 28
+#define SYS_clock_gettime 29
+#define SYS_nanosleep 30
+#define SYS_clone  31
+#define SYS_join   32
+#define SYS_futex_wait 33
+#define SYS_futex_wake 34
+#define SYS_lockstat 35
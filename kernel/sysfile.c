@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "spawn.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -23,10 +24,20 @@ argfd(int n, int *pfd, struct file **pf)
 {
   int fd;
   struct file *f;
+  struct proc *p = myproc();
+  struct proc *m = p->main;
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE)
+    return -1;
+  // another thread may close fd while the system call uses f,
+  // so hold a reference, which syscall() lets go of after.
+  acquire(&m->lock);
+  if((f = m->ofile[fd]) != 0 && m->nthread > 1)
+    p->fpin = filedup(f);
+  release(&m->lock);
+  if(f == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -41,14 +52,17 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct proc *m = myproc()->main;
 
+  acquire(&m->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
+    if(m->ofile[fd] == 0){
+      m->ofile[fd] = f;
+      release(&m->lock);
       return fd;
     }
   }
+  release(&m->lock);
   return -1;
 }
 
@@ -96,10 +110,18 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct proc *m = myproc()->main;
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
+  acquire(&m->lock);
+  if(m->ofile[fd] != f){
+    // another thread closed it first.
+    release(&m->lock);
+    return -1;
+  }
+  m->ofile[fd] = 0;
+  release(&m->lock);
   fileclose(f);
   return 0;
 }
@@ -283,17 +305,14 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-uint64
-sys_open(void)
+// Open path with mode omode, as open() does, but
+// without giving the file a descriptor.
+// Returns the file, or 0.
+struct file*
+fileopen(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
-    return -1;
 
   begin_op();
 
@@ -301,33 +320,31 @@ sys_open(void)
     ip = create(path, T_FILE, 0, 0);
     if(ip == 0){
       end_op();
-      return -1;
+      return 0;
     }
   } else {
     if((ip = namei(path)) == 0){
       end_op();
-      return -1;
+      return 0;
     }
     ilock(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
       end_op();
-      return -1;
+      return 0;
     }
   }
 
   if(ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
   if(ip->type == T_DEVICE){
@@ -348,6 +365,24 @@ sys_open(void)
   iunlock(ip);
   end_op();
 
+  return f;
+}
+
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int fd, omode;
+  struct file *f;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  if((f = fileopen(path, omode)) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -391,8 +426,8 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
-  struct proc *p = myproc();
+  struct inode *ip, *old;
+  struct proc *m = myproc()->main;
   
   begin_op();
   if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
@@ -406,25 +441,33 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  // namex() may be taking another thread's reference to it.
+  acquire(&m->lock);
+  old = m->cwd;
+  m->cwd = ip;
+  release(&m->lock);
+  iput(old);
   end_op();
-  p->cwd = ip;
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Fetch the user's argument vector at uargv into argv,
+// which has MAXARG entries, one kmalloc()ed string each.
+// Returns 0, or -1 with nothing left allocated.
+static int
+fetchargv(uint64 uargv, char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
-  int i;
-  uint64 uargv, uarg;
+  char *buf;
+  int i, n;
+  uint64 uarg;
 
-  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+  // fetch each argument into one scratch page, then keep
+  // only as many bytes of it as the string needs.
+  if((buf = kalloc()) == 0)
     return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(argv[0]));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
+    if(i >= MAXARG){
       goto bad;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
@@ -434,24 +477,94 @@ sys_exec(void)
       argv[i] = 0;
       break;
     }
-    argv[i] = kalloc();
-    if(argv[i] == 0)
+    if((n = fetchstr(uarg, buf, PGSIZE)) < 0)
       goto bad;
-    if(fetchstr(uarg, argv[i], PGSIZE) < 0)
+    argv[i] = kmalloc(n + 1);
+    if(argv[i] == 0)
       goto bad;
+    memmove(argv[i], buf, n + 1);
   }
+  kfree(buf);
+  return 0;
+
+ bad:
+  kfree(buf);
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
+    kmfree(argv[i]);
+  return -1;
+}
+
+static void
+freeargv(char **argv)
+{
+  int i;
+
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
+    kmfree(argv[i]);
+}
+
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+  int ret;
 
-  int ret = exec(path, argv);
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  if(fetchargv(uargv, argv) < 0)
+    return -1;
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
+  ret = exec(path, argv);
 
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  struct spawnact act[NSPAWNACT];
+  uint64 uargv, uact;
+  int i, nact, ret;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0 ||
+     argaddr(2, &uact) < 0 || argint(3, &nact) < 0)
+    return -1;
+  if(nact < 0 || nact > NSPAWNACT)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)act, uact, nact*sizeof(act[0])) < 0)
+    return -1;
+
+  // bring in the paths to open; the rest of each
+  // action is checked as the child's files are set up.
+  for(i = 0; i < nact; i++){
+    if(act[i].op != SPAWN_OPEN){
+      act[i].path = 0;
+      continue;
+    }
+    uint64 upath = (uint64)act[i].path;
+    if((act[i].path = kmalloc(MAXPATH)) == 0 ||
+       fetchstr(upath, act[i].path, MAXPATH) < 0){
+      nact = i + 1;
+      ret = -1;
+      goto out;
+    }
+  }
+
+  ret = -1;
+  if(fetchargv(uargv, argv) == 0){
+    ret = spawn(path, argv, act, nact);
+    freeargv(argv);
+  }
+
+ out:
+  for(i = 0; i < nact; i++)
+    if(act[i].path)
+      kmfree(act[i].path);
+  return ret;
 }
 
 uint64
@@ -469,18 +582,77 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
+      p->main->ofile[fd0] = 0;
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    p->main->ofile[fd0] = 0;
+    p->main->ofile[fd1] = 0;
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   return 0;
 }
+
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len, off;
+  int prot, flags;
+  struct file *f;
+
+  // the kernel chooses the address; addr is only a hint.
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argfd(4, 0, &f) < 0 || argaddr(5, &off) < 0)
+    return -1;
+  return mmap(f, len, prot, flags, off);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  if(argaddr(0, &addr) < 0 || argaddr(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+// Open a shared memory segment; a null name
+// makes a new anonymous one.
+uint64
+sys_shmopen(void)
+{
+  char name[SHMNAME];
+  uint64 uname;
+  int fd, size, omode;
+  struct file *f;
+
+  if(argaddr(0, &uname) < 0 || argint(1, &size) < 0 || argint(2, &omode) < 0)
+    return -1;
+  if(size < 0)
+    return -1;
+  if(uname && fetchstr(uname, name, SHMNAME) < 0)
+    return -1;
+  if((f = shmopen(uname ? name : 0, size, omode)) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+uint64
+sys_shmunlink(void)
+{
+  char name[SHMNAME];
+
+  if(argstr(0, name, SHMNAME) < 0)
+    return -1;
+  return shmunlink(name);
+}
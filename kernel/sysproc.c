@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "time.h"
 
 uint64
 sys_exit(void)
@@ -43,12 +44,16 @@ sys_sbrk(void)
 {
   int addr;
   int n;
+  struct proc *p = myproc();
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
+  // another thread may be growing the process too.
+  vmlock(p);
+  addr = p->main->sz;
   if(growproc(n) < 0)
-    return -1;
+    addr = -1;
+  vmunlock(p);
   return addr;
 }
 
@@ -56,21 +61,12 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n <= 0)
+    return 0;
+  return clocksleep(r_time() + (uint64)n * TICKCYCLES);
 }
 
 uint64
@@ -83,15 +79,123 @@ sys_kill(void)
   return kill(pid);
 }
 
-// return how many clock tick interrupts have occurred
+uint64
+sys_setpriority(void)
+{
+  int pid, prio;
+
+  if(argint(0, &pid) < 0 || argint(1, &prio) < 0)
+    return -1;
+  return setpriority(pid, prio);
+}
+
+uint64
+sys_getpriority(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getpriority(pid);
+}
+
+// return how many clock ticks have gone by
 // since start.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  return tickcount();
+}
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+// read the time from the CLINT's mtime through the time
+// CSR, which needs no lock.
+uint64
+sys_clock_gettime(void)
+{
+  struct timespec ts;
+  uint64 addr, t;
+  int clk;
+
+  if(argint(0, &clk) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  if(clk != CLOCK_MONOTONIC)
+    return -1;
+  t = r_time();
+  ts.sec = t / MTIMEFREQ;
+  ts.nsec = (t % MTIMEFREQ) * NSPERCYCLE;
+  if(copyout(myproc()->pagetable, addr, (char*)&ts, sizeof(ts)) < 0)
+    return -1;
+  return 0;
+}
+
+// sleep for at least the time in the timespec at addr,
+// to the resolution of mtime.
+uint64
+sys_nanosleep(void)
+{
+  struct timespec ts;
+  uint64 addr, cycles;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  if(copyin(myproc()->pagetable, (char*)&ts, addr, sizeof(ts)) < 0)
+    return -1;
+  if(ts.nsec >= 1000000000L || ts.sec > 1000000000L)
+    return -1;
+  cycles = ts.sec * MTIMEFREQ + (ts.nsec + NSPERCYCLE - 1) / NSPERCYCLE;
+  if(cycles == 0)
+    return 0;
+  return clocksleep(r_time() + cycles);
+}
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 || argaddr(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
+uint64
+sys_join(void)
+{
+  uint64 p;
+  if(argaddr(0, &p) < 0)
+    return -1;
+  return join(p);
+}
+
+uint64
+sys_futex_wait(void)
+{
+  uint64 addr;
+  int val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futexwait(addr, val);
+}
+
+uint64
+sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futexwake(addr, n);
+}
+
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return lockstat(addr, n);
 }
@@ -0,0 +1,212 @@
+//
+// Cache of read-only program pages, shared by all processes
+// running the same program.
+//
+// segfault() asks textget() for each page of a read-only
+// segment (text and rodata) that a process touches. The cache
+// keeps the page, keyed by the program file's device, inode
+// number and file offset, and hands out references to it, so
+// that every process running the program maps the same
+// physical page. The cache holds a reference of its own, so
+// pages stay around for the next exec() of the program.
+//
+// Writing or truncating a file drops its pages from the cache;
+// processes already mapping them keep the old contents. Pages
+// only the cache refers to are evicted when the cache is full,
+// and all of them when kalloc() runs out of memory.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "defs.h"
+
+#define NTEXTPG   512   // most pages cached at once
+#define NTEXTHASH 61
+
+struct tpage {
+  uint dev;
+  uint inum;
+  uint off;             // file offset of the page
+  int n;                // bytes from the file; the rest is zero
+  char *pa;
+  struct tpage *next;   // in hash bucket
+};
+
+struct {
+  struct spinlock lock;
+  struct tpage *hash[NTEXTHASH]; // all pages of an inode share a bucket
+  int n;                // pages cached
+  int hand;             // next bucket to look for a victim in
+  uint64 nhit;
+  uint64 nmiss;
+  uint64 nevict;
+  uint64 ninval;
+} text;
+
+static struct kmem_cache *tpagecache;
+
+void
+textinit(void)
+{
+  initlock(&text.lock, "text");
+  tpagecache = kmem_cache_create("tpage", sizeof(struct tpage));
+}
+
+static struct tpage**
+bucket(uint dev, uint inum)
+{
+  return &text.hash[(dev * 31 + inum) % NTEXTHASH];
+}
+
+// Take a page that only the cache refers to out of it.
+// Returns 0 if every cached page is mapped somewhere.
+// Caller holds text.lock.
+static struct tpage*
+victim(void)
+{
+  struct tpage **pp, *t;
+
+  for(int i = 0; i < NTEXTHASH; i++){
+    pp = &text.hash[text.hand];
+    text.hand = (text.hand + 1) % NTEXTHASH;
+    for(; (t = *pp) != 0; pp = &t->next){
+      if(krefcnt(t->pa) == 1){
+        *pp = t->next;
+        text.n--;
+        text.nevict++;
+        return t;
+      }
+    }
+  }
+  return 0;
+}
+
+// Return a page holding n bytes of ip at offset off, zero
+// beyond them, with a reference taken for the caller, who
+// must map it read-only. Caller holds ip's lock, so no one
+// else can be filling in or invalidating ip's pages.
+// Returns 0 if the file could not be read or memory ran out.
+char*
+textget(struct inode *ip, uint off, int n)
+{
+  struct tpage *t, *old, **b;
+  char *mem;
+
+  b = bucket(ip->dev, ip->inum);
+  acquire(&text.lock);
+  for(t = *b; t != 0; t = t->next){
+    if(t->dev == ip->dev && t->inum == ip->inum && t->off == off && t->n == n){
+      krefinc(t->pa);
+      text.nhit++;
+      release(&text.lock);
+      return t->pa;
+    }
+  }
+  text.nmiss++;
+  release(&text.lock);
+
+  if((mem = kalloc_zeroed()) == 0)
+    return 0;
+  if(readi(ip, 0, (uint64)mem, off, n) != n){
+    kfree(mem);
+    return 0;
+  }
+  if((t = kmem_cache_alloc(tpagecache)) == 0)
+    return mem;   // not cached, but still usable
+  t->dev = ip->dev;
+  t->inum = ip->inum;
+  t->off = off;
+  t->n = n;
+  t->pa = mem;
+
+  old = 0;
+  acquire(&text.lock);
+  if(text.n >= NTEXTPG && (old = victim()) == 0){
+    release(&text.lock);
+    kmem_cache_free(tpagecache, t);
+    return mem;
+  }
+  krefinc(mem);
+  t->next = *b;
+  *b = t;
+  text.n++;
+  ip->text = 1;
+  release(&text.lock);
+
+  if(old){
+    kfree(old->pa);
+    kmem_cache_free(tpagecache, old);
+  }
+  return mem;
+}
+
+// Drop ip's pages from the cache. Called with ip
+// locked whenever ip's contents are about to change.
+void
+textinval(struct inode *ip)
+{
+  struct tpage **pp, *t, *dead;
+
+  dead = 0;
+  acquire(&text.lock);
+  for(pp = bucket(ip->dev, ip->inum); (t = *pp) != 0; ){
+    if(t->dev == ip->dev && t->inum == ip->inum){
+      *pp = t->next;
+      t->next = dead;
+      dead = t;
+      text.n--;
+      text.ninval++;
+    } else {
+      pp = &t->next;
+    }
+  }
+  ip->text = 0;
+  release(&text.lock);
+
+  while((t = dead) != 0){
+    dead = t->next;
+    kfree(t->pa);
+    kmem_cache_free(tpagecache, t);
+  }
+}
+
+// Free every cached page that no process maps.
+// Called by kalloc() when it runs out of memory.
+// Returns the number of pages freed.
+int
+textreap(void)
+{
+  struct tpage *t, *dead;
+  int n;
+
+  dead = 0;
+  acquire(&text.lock);
+  while((t = victim()) != 0){
+    t->next = dead;
+    dead = t;
+  }
+  release(&text.lock);
+
+  n = 0;
+  while((t = dead) != 0){
+    dead = t->next;
+    kfree(t->pa);
+    kmem_cache_free(tpagecache, t);
+    n++;
+  }
+  return n;
+}
+
+// Report the cache's size and hit rate for the statistics device.
+int
+textstats(char *buf, int sz)
+{
+  return snprintf(buf, sz, "text: pages %d hit %l miss %l evict %l inval %l\n",
+                  text.n, text.nhit, text.nmiss, text.nevict, text.ninval);
+}
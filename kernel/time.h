@@ -0,0 +1,8 @@
+// clock_gettime() and nanosleep().
+
+#define CLOCK_MONOTONIC 0   // time since boot; the only clock
+
+struct timespec {
+  uint64 sec;
+  uint64 nsec;    // 0 to 999999999
+};
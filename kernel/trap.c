@@ -6,9 +6,6 @@
 #include "proc.h"
 #include "defs.h"
 
-struct spinlock tickslock;
-uint ticks;
-
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
@@ -16,10 +13,14 @@ void kernelvec();
 
 extern int devintr();
 
+// timervec in kernelvec.S sets timer_scratch[hart][5]
+// for each timer interrupt it passes on.
+extern uint64 timer_scratch[NCPU][6];
+
 void
 trapinit(void)
 {
-  initlock(&tickslock, "time");
+  clockinit();
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -67,6 +68,20 @@ usertrap(void)
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    // page fault on a lazily allocated, copy-on-write or
+    // swapped-out page. allow interrupts, as for system
+    // calls, since kalloc() may have to sleep in swapout().
+    uint64 scause = r_scause();
+    uint64 stval = r_stval();
+    intr_on();
+    if(vmfault(p->pagetable, stval, scause == 15) == 0){
+      asidflushva(p, stval);
+    } else {
+      printf("usertrap(): unexpected scause %p pid=%d\n", scause, p->pid);
+      printf("            sepc=%p stval=%p\n", p->trapframe->epc, stval);
+      p->killed = 1;
+    }
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
@@ -76,8 +91,9 @@ usertrap(void)
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this is a timer interrupt
+  // and the scheduler says p's time is up.
+  if(which_dev == 2 && timeslice(p))
     yield();
 
   usertrapret();
@@ -119,13 +135,14 @@ usertrapret(void)
   w_sepc(p->trapframe->epc);
 
   // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  // the scheduler made sure p's ASID is current on this hart.
+  uint64 satp = MAKE_SATP_ASID(p->pagetable, p->asid);
 
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(p->tfva, satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -133,25 +150,46 @@ usertrapret(void)
 void 
 kerneltrap()
 {
-  int which_dev = 0;
+  int which_dev = 0, handled = 0;
   uint64 sepc = r_sepc();
   uint64 sstatus = r_sstatus();
   uint64 scause = r_scause();
+  uint64 stval = r_stval();
   
   if((sstatus & SSTATUS_SPP) == 0)
     panic("kerneltrap: not from supervisor mode");
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
-  if((which_dev = devintr()) == 0){
+  if((which_dev = devintr()) == 0 && (scause == 13 || scause == 15)){
+    // a page fault, which had better be in ucopy() or
+    // ucopystr(). handling it may sleep, and this hart run
+    // other code meanwhile, so turn off access to user
+    // memory until the w_sstatus() below resumes the copy.
+    // allow interrupts if the copy did (it holds no spinlock),
+    // as usertrap() does, since kalloc() may have to sleep in
+    // swapout(); scause, sepc and stval were saved above.
+    w_sstatus(sstatus & ~SSTATUS_SUM);
+    if(sstatus & SSTATUS_SPIE)
+      intr_on();
+    handled = ucopytrap(&sepc, stval, scause == 15);
+    intr_off();
+  }
+  if(which_dev == 0 && !handled){
     printf("scause %p\n", scause);
-    printf("sepc=%p stval=%p\n", r_sepc(), r_stval());
+    printf("sepc=%p stval=%p\n", r_sepc(), stval);
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  // give up the CPU if this is a timer interrupt. the process
+  // may be part way through changing its page table, so keep
+  // swapout() away from it until it runs again.
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING &&
+     timeslice(myproc())){
+    myproc()->vmbusy++;
     yield();
+    myproc()->vmbusy--;
+  }
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -159,15 +197,6 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
-void
-clockintr()
-{
-  acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
-  release(&tickslock);
-}
-
 // check if it's an external interrupt or software interrupt,
 // and handle it.
 // returns 2 if timer interrupt,
@@ -201,18 +230,25 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer or software
+    // interrupt, forwarded by timervec in kernelvec.S. the
+    // latter wakes an idle hart (see runqidle()), or asks for
+    // a TLB flush (see shootdown() in asid.c).
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
+    // the SSIP bit in sip, before looking at the flag,
+    // so that a tick arriving meanwhile is not lost.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    // another hart may want this one's TLB flushed.
+    asidintr();
+
+    if(__sync_lock_test_and_set(&timer_scratch[cpuid()][5], 0) == 0)
+      return 1;
+
+    // only a timer interrupt that ends the running
+    // process's tick counts as one to the caller.
+    return clockintr() ? 2 : 1;
   } else {
     return 0;
   }
@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -15,14 +17,28 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// ucopy.S
+extern char ucopystart[], ucopyend[], ucopyfault[];
+int ucopy(void *dst, const void *src, uint64 n);
+int ucopystr(char *dst, const char *src, uint64 max);
+
+// build with NOMEGAPAGE=1 to map the kernel with 4 KB pages
+// only, e.g. to compare against with kvmbench.
+#ifdef NOMEGAPAGE
+#define KVMMEGA 0
+#else
+#define KVMMEGA 1
+#endif
+
+static pte_t *walklevel(pagetable_t, uint64, int, int);
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
 {
   pagetable_t kpgtbl;
 
-  kpgtbl = (pagetable_t) kalloc();
-  memset(kpgtbl, 0, PGSIZE);
+  kpgtbl = (pagetable_t) kalloc_zeroed();
 
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
@@ -33,7 +49,12 @@ kvmmake(void)
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
+  // CLINT, for software interrupts to other harts
+  kvmmap(kpgtbl, KCLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // map kernel text executable and read-only.
+  // like the rest of the direct map, it gets 2 MB megapages
+  // wherever va and pa are suitably aligned (see mappages()).
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
@@ -65,6 +86,51 @@ kvminithart()
   sfence_vma();
 }
 
+// Make a kernel page table for a process whose user page table
+// is pagetable. It is a copy of the kernel's top-level page,
+// except that the first 1 GB comes from pagetable, whose
+// level-1 page holds the user's memory below UVMTOP and the
+// kernel's device mappings above it (see uvmcreate()). So
+// the user's memory is visible to the kernel at the same
+// addresses, with no copying of PTEs to keep in sync.
+// Returns 0 if out of memory.
+pagetable_t
+kvmcreate(pagetable_t pagetable)
+{
+  pagetable_t kpagetable;
+
+  if((kpagetable = (pagetable_t) kalloc()) == 0)
+    return 0;
+  memmove(kpagetable, kernel_pagetable, PGSIZE);
+  kpagetable[0] = pagetable[0];
+  return kpagetable;
+}
+
+// Free a page table made by kvmcreate().
+// Everything below the top level is shared.
+void
+kvmfree(pagetable_t kpagetable)
+{
+  kfree((void*)kpagetable);
+}
+
+// Switch this hart to p's kernel page table, or to the
+// global one if p is 0. The scheduler runs on the global
+// one between processes, whose page tables may be freed.
+void
+kvmswitch(struct proc *p)
+{
+  push_off();
+  if(p)
+    w_satp(asidsatp(p, p->kpagetable));
+  else
+    w_satp(MAKE_SATP(kernel_pagetable));
+#ifdef NOASID
+  sfence_vma();
+#endif
+  pop_off();
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -77,28 +143,41 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// If va is mapped by a megapage, returns its level-1 leaf PTE.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, alloc, 0);
+}
+
+// Like walk(), but return the PTE at the given level
+// (0 for 4 KB pages, 1 for 2 MB megapages), or an
+// existing leaf PTE found at a higher level.
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int alloc, int level)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
-    pte_t *pte = &pagetable[PX(level, va)];
+  for(int l = 2; l > level; l--) {
+    pte_t *pte = &pagetable[PX(l, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte))
+        return pte;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
-  return &pagetable[PX(0, va)];
+  return &pagetable[PX(level, va)];
 }
 
 // Look up a virtual address, return the physical address,
-// or 0 if not mapped.
+// or 0 if not mapped. Allocates a page the current process
+// has reserved with sbrk() but not yet touched.
 // Can only be used to look up user pages.
 uint64
 walkaddr(pagetable_t pagetable, uint64 va)
@@ -109,6 +188,8 @@ walkaddr(pagetable_t pagetable, uint64 va)
   if(va >= MAXVA)
     return 0;
 
+  if(vmfault(pagetable, va, 0) < 0)
+    return 0;
   pte = walk(pagetable, va, 0);
   if(pte == 0)
     return 0;
@@ -134,10 +215,16 @@ kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 // physical addresses starting at pa. va and size might not
 // be page-aligned. Returns 0 on success, -1 if walk() couldn't
 // allocate a needed page-table page.
+//
+// Kernel (non-PTE_U) mappings use a 2 MB megapage for each
+// piece where va and pa are 2 MB aligned and the whole 2 MB
+// is covered, unless a level-0 page table is already there.
+// User mappings always use 4 KB pages, which is what the
+// rest of the user memory code expects.
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
-  uint64 a, last;
+  uint64 a, last, step;
   pte_t *pte;
 
   if(size == 0)
@@ -146,21 +233,80 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
   for(;;){
-    if((pte = walk(pagetable, a, 1)) == 0)
+    pte = 0;
+    step = PGSIZE;
+    if(KVMMEGA && (perm & PTE_U) == 0 &&
+       a % MEGAPGSIZE == 0 && pa % MEGAPGSIZE == 0 &&
+       last - a >= MEGAPGSIZE - PGSIZE){
+      if((pte = walklevel(pagetable, a, 1, 1)) == 0)
+        return -1;
+      if((*pte & PTE_V) && !PTE_LEAF(*pte))
+        pte = 0;   // part of this 2 MB is already mapped by 4 KB pages
+      else
+        step = MEGAPGSIZE;
+    }
+    if(pte == 0 && (pte = walk(pagetable, a, 1)) == 0)
       return -1;
     if(*pte & PTE_V)
       panic("mappages: remap");
     *pte = PA2PTE(pa) | perm | PTE_V;
-    if(a == last)
+    if(last - a < step)
       break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    a += step;
+    pa += step;
   }
   return 0;
 }
 
+// Count the page-table pages under pagetable, which sits at
+// the given level, and the leaf PTEs at each level.
+static void
+kvmcount(pagetable_t pagetable, int level, int *npt, int *nleaf)
+{
+  (*npt)++;
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if((pte & PTE_V) == 0)
+      continue;
+    if(PTE_LEAF(pte))
+      nleaf[level]++;
+    else
+      kvmcount((pagetable_t)PTE2PA(pte), level-1, npt, nleaf);
+  }
+}
+
+#define NWALKBENCH 65536
+
+// Report the kernel page table's footprint, and the
+// average cost of a software walk of the direct map,
+// for the statistics device.
+int
+kvmstats(char *buf, int sz)
+{
+  int npt, nleaf[3];
+  uint64 va, t0, t;
+
+  npt = 0;
+  nleaf[0] = nleaf[1] = nleaf[2] = 0;
+  kvmcount(kernel_pagetable, 2, &npt, nleaf);
+
+  t0 = r_time();
+  for(int i = 0; i < NWALKBENCH; i++){
+    va = KERNBASE + ((uint64)i * 7919 * PGSIZE) % (PHYSTOP - KERNBASE);
+    if(walk(kernel_pagetable, va, 0) == 0)
+      panic("kvmstats");
+  }
+  t = r_time() - t0;
+
+  return snprintf(buf, sz, "kvm: pt pages %d leaves 4K %d 2M %d walk %l ns\n",
+                  npt, nleaf[0], nleaf[1],
+                  t * (1000000000 / MTIMEFREQ) / NWALKBENCH);
+}
+
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that were never mapped (see lazy
+// allocation in vmfault()) are skipped, and the swap slots
+// of swapped-out pages freed.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
@@ -172,12 +318,18 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-    if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
-    if(PTE_FLAGS(*pte) == PTE_V)
-      panic("uvmunmap: not a leaf");
+    if((pte = walk(pagetable, a, 0)) == 0){
+      // no level-0 page table: skip to the next one.
+      a = (a & ~(MEGAPGSIZE - 1)) + MEGAPGSIZE - PGSIZE;
+      continue;
+    }
+    if((*pte & PTE_V) == 0){
+      if(*pte & PTE_SWAP){
+        swapfree(PTE2SLOT(*pte));
+        *pte = 0;
+      }
+      continue;   // never touched, with lazy sbrk
+    }
     if(do_free){
       uint64 pa = PTE2PA(*pte);
       kfree((void*)pa);
@@ -186,16 +338,27 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
   }
 }
 
-// create an empty user page table.
+// create an empty user page table, whose level-1 page for
+// the first 1 GB also holds the kernel's device mappings
+// above UVMTOP, without PTE_U (see kvmcreate()).
 // returns 0 if out of memory.
 pagetable_t
 uvmcreate()
 {
-  pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable_t pagetable, l1, kl1;
+
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
+  l1 = (pagetable_t) kalloc_zeroed();
+  if(l1 == 0){
+    kfree(pagetable);
+    return 0;
+  }
+  kl1 = (pagetable_t) PTE2PA(kernel_pagetable[0]);
+  for(int i = PX(1, UVMTOP); i < 512; i++)
+    l1[i] = kl1[i];
+  pagetable[0] = PA2PTE(l1) | PTE_V;
   return pagetable;
 }
 
@@ -209,8 +372,7 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -228,12 +390,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -286,48 +447,230 @@ freewalk(pagetable_t pagetable)
 void
 uvmfree(pagetable_t pagetable, uint64 sz)
 {
+  pagetable_t l1;
+
   if(sz > 0)
     uvmunmap(pagetable, 0, PGROUNDUP(sz)/PGSIZE, 1);
+  // the device mappings belong to the kernel.
+  l1 = (pagetable_t) PTE2PA(pagetable[0]);
+  for(int i = PX(1, UVMTOP); i < 512; i++)
+    l1[i] = 0;
   freewalk(pagetable);
 }
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Copies only the page table: the child shares the
+// parent's physical pages, and writable pages become
+// read-only and copy-on-write in both (see vmfault()),
+// so the caller must flush the parent's TLB entries.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
+  return uvmcopyrange(old, new, 0, sz, 0);
+}
+
+// Like uvmcopy(), for the pages in [start, end). If shared
+// is set, writable pages stay writable and are truly shared,
+// as for MAP_SHARED mappings, rather than copy-on-write.
+int
+uvmcopyrange(pagetable_t old, pagetable_t new, uint64 start, uint64 end, int shared)
+{
+  pte_t *pte, *npte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
+  for(i = start; i < end; i += PGSIZE){
+    if((pte = walk(old, i, 0)) == 0){
+      // no level-0 page table: skip to the next one.
+      i = (i & ~(MEGAPGSIZE - 1)) + MEGAPGSIZE - PGSIZE;
+      continue;
+    }
+    if(*pte & PTE_SWAP){
+      // the child shares the swap slot.
+      if((npte = walk(new, i, 1)) == 0)
+        goto err;
+      swapdup(PTE2SLOT(*pte));
+      *npte = *pte;
+      continue;
+    }
     if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+      continue;   // not yet allocated; the child faults it in too
+    if(!shared && (*pte & PTE_W))
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+    // the new reference also keeps swapout() off the
+    // page if mappages() has to wait for memory.
+    krefinc((void*)pa);
+    if(mappages(new, i, PGSIZE, pa, flags) != 0){
+      kfree((void*)pa);
       goto err;
     }
   }
+  // the caller must flush the old PTEs, which may have lost PTE_W.
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
-// mark a PTE invalid for user access.
+static int dofault(struct proc*, pagetable_t, uint64, int);
+
+// Handle a page fault at user virtual address va: read in
+// a page of an mmap()ed file, of the program (exec()
+// loads programs lazily) or from swap, allocate a zeroed page if va
+// is below the current process's size but was never touched
+// (sbrk() allocates lazily), and give a copy-on-write page
+// its own writable copy if write is set.
+// Returns 0 if the access may be retried, -1 if va is not
+// legitimately accessible or memory ran out.
+int
+vmfault(pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *p = myproc();
+  int r;
+
+  if(p == 0 || pagetable != p->pagetable)
+    return dofault(p, pagetable, va, write);
+
+  // threads sharing the page table may fault on the
+  // same page at once.
+  vmlock(p);
+  r = dofault(p, pagetable, va, write);
+  vmunlock(p);
+  return r;
+}
+
+// Map mem, read in for a page fault at va, perhaps with
+// vmlock() let go meanwhile, unless another thread has
+// faulted the page in first. Returns 0, or -1 if out of memory.
+int
+vmfill(pagetable_t pagetable, uint64 va, char *mem, int perm)
+{
+  pte_t *pte;
+
+  if((pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_V)){
+    kfree(mem);
+    return 0;
+  }
+  if(mappages(pagetable, va, PGSIZE, (uint64)mem, perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Fault in the pages of [va, va+n) in the current process
+// that are read in from a file, before the caller locks an
+// inode and copies to (write) or from them; see the lock
+// order in mmap.c. Other pages take no inode lock to fault
+// in, and are left to the copy, as are any errors.
+void
+uvmprefault(uint64 va, uint64 n, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  uint64 a, end;
+  int file;
+
+  end = va + n;
+  if(end > UVMTOP || end < va)
+    end = UVMTOP;
+  for(a = PGROUNDDOWN(va); a < end; a += PGSIZE){
+    if((pte = walk(p->pagetable, a, 0)) != 0 && (*pte & PTE_V))
+      continue;
+    vmlock(p);
+    file = vmalookup(p->main, a) != 0 ||
+           (a < p->main->sz && seglookup(p->main, a) != 0);
+    vmunlock(p);
+    if(file)
+      vmfault(p->pagetable, a, write);
+  }
+}
+
+static int
+dofault(struct proc *p, pagetable_t pagetable, uint64 va, int write)
+{
+  struct proc *m;
+  struct vma *v;
+  struct seg *sg;
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  pte = walk(pagetable, va, 0);
+  if(pte && (*pte & PTE_SWAP) && swapin(pte) < 0)
+    return -1;
+  if(pte == 0 || (*pte & PTE_V) == 0){
+    if(p == 0 || pagetable != p->pagetable)
+      return -1;
+    m = p->main;
+    if((v = vmalookup(m, va)) != 0)
+      return mmapfault(m, v, va, write);
+    if(va >= m->sz)
+      return -1;
+    if((sg = seglookup(m, va)) != 0){
+      if(segfault(m, sg, va) < 0)
+        return -1;
+      // text is mapped read-only.
+      return write && (sg->perm & PTE_W) == 0 ? -1 : 0;
+    }
+    if((mem = kalloc_zeroed()) == 0)
+      return -1;
+    if(mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
+      kfree(mem);
+      return -1;
+    }
+    return 0;
+  }
+  if((*pte & PTE_U) == 0)
+    return -1;
+  if(!write)
+    return 0;
+  if(*pte & PTE_W){
+    // the kernel is about to write through the direct map,
+    // which does not set the user PTE's dirty bit.
+    *pte |= PTE_D;
+    return 0;
+  }
+  if((*pte & PTE_COW) == 0)
+    return -1;
+
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W | PTE_D;
+  if(krefcnt((void*)pa) == 1){
+    // no one else shares it any more.
+    *pte = PA2PTE(pa) | flags;
+  } else {
+    // keep swapout() off pa while kalloc() may sleep.
+    if(p)
+      p->vmbusy++;
+    if((mem = kalloc()) != 0)
+      memmove(mem, (char*)pa, PGSIZE);
+    if(p)
+      p->vmbusy--;
+    if(mem == 0)
+      return -1;
+    *pte = PA2PTE(mem) | flags;
+    kfree((void*)pa);
+  }
+  if(p && pagetable == p->pagetable)
+    asidflush(p);
+  return 0;
+}
+
+// mark a PTE invalid for any access, leaving it valid so that
+// vmfault() does not fill it in. A level-0 PTE with no R, W or
+// X faults even for the kernel, which sees user memory through
+// the process's kernel page table.
 // used by exec for the user stack guard page.
 void
 uvmclear(pagetable_t pagetable, uint64 va)
@@ -337,22 +680,70 @@ uvmclear(pagetable_t pagetable, uint64 va)
   pte = walk(pagetable, va, 0);
   if(pte == 0)
     panic("uvmclear");
-  *pte &= ~PTE_U;
+  *pte &= ~(PTE_U|PTE_R|PTE_W|PTE_X);
+}
+
+// Is [va, va+len) user memory that the current process's
+// kernel page table maps, so that it can be copied directly?
+// Build with NOUCOPY=1 to always walk the page table, for
+// comparison.
+static int
+ucopyok(pagetable_t pagetable, uint64 va, uint64 len)
+{
+#ifdef NOUCOPY
+  return 0;
+#else
+  struct proc *p = myproc();
+
+  return p != 0 && pagetable == p->pagetable && va < UVMTOP && len <= UVMTOP - va;
+#endif
+}
+
+// Called by kerneltrap() for a page fault at va in kernel mode.
+// If it happened while ucopy() or ucopystr() was touching user
+// memory, fault the page in and resume, or make the copy return
+// -1 if va is not accessible. Returns 0 if the fault was not
+// in a user copy.
+int
+ucopytrap(uint64 *sepc, uint64 va, int write)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || *sepc < (uint64)ucopystart || *sepc >= (uint64)ucopyend)
+    return 0;
+  if(vmfault(p->pagetable, va, write) == 0)
+    asidflushva(p, va);
+  else
+    *sepc = (uint64)ucopyfault;
+  return 1;
 }
 
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
+// The current process's memory is written directly, with faults
+// handled as for user stores; other page tables are walked.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
+  int r;
+
+  if(ucopyok(pagetable, dstva, len)){
+    w_sstatus(r_sstatus() | SSTATUS_SUM);
+    r = ucopy((void*)dstva, src, len);
+    w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    return r;
+  }
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    // break copy-on-write sharing, as a user store would.
+    if(vmfault(pagetable, va0, 1) < 0)
       return -1;
+    pte = walk(pagetable, va0, 0);
+    pa0 = PTE2PA(*pte);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -372,6 +763,14 @@ int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
+  int r;
+
+  if(ucopyok(pagetable, srcva, len)){
+    w_sstatus(r_sstatus() | SSTATUS_SUM);
+    r = ucopy(dst, (void*)srcva, len);
+    w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    return r;
+  }
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
@@ -399,6 +798,16 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
   uint64 n, va0, pa0;
   int got_null = 0;
+  int r;
+
+  if(ucopyok(pagetable, srcva, 0)){
+    if(max > UVMTOP - srcva)
+      max = UVMTOP - srcva;
+    w_sstatus(r_sstatus() | SSTATUS_SUM);
+    r = ucopystr(dst, (char*)srcva, max);
+    w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    return r;
+  }
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
@@ -0,0 +1,81 @@
+//
+// Time system calls and context switches, which each cross
+// between the user and kernel page tables, and print how many
+// TLB flushes they caused. Compare a normal kernel, which tags
+// page tables with ASIDs, against one built with make NOASID=1.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NCALL   100000
+#define NSWITCH 5000
+
+// Touch a few pages between calls, as a real program would,
+// so that a flushed TLB has something to miss on.
+char data[8*4096];
+
+void
+syscalls(void)
+{
+  int i, t0;
+
+  t0 = uptime();
+  for(i = 0; i < NCALL; i++){
+    data[(i % 8) * 4096]++;
+    getpid();
+  }
+  printf("%d getpid(): %d ticks\n", NCALL, uptime() - t0);
+}
+
+// Bounce a byte between two processes over a pair of pipes;
+// each round trip is at least two context switches.
+void
+switches(void)
+{
+  int ping[2], pong[2], i, t0, pid;
+  char c = 0;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("asidbench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf("asidbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < NSWITCH; i++){
+      if(read(ping[0], &c, 1) != 1)
+        exit(1);
+      data[(i % 8) * 4096]++;
+      write(pong[1], &c, 1);
+    }
+    exit(0);
+  }
+  for(i = 0; i < NSWITCH; i++){
+    write(ping[1], &c, 1);
+    data[(i % 8) * 4096]++;
+    if(read(pong[0], &c, 1) != 1){
+      printf("asidbench: read failed\n");
+      exit(1);
+    }
+  }
+  wait(0);
+  printf("%d pipe round trips: %d ticks\n", NSWITCH, uptime() - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  printstat("asid");
+  syscalls();
+  switches();
+  printstat("asid");
+  printf("asidbench: OK\n");
+  exit(0);
+}
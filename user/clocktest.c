@@ -0,0 +1,164 @@
+//
+// Test the tickless clock: sleep() lasts as long as asked,
+// several sleepers with different deadlines each wake when
+// theirs comes, and harts with nothing to do take far fewer
+// timer interrupts than a fixed tick would give them. Then
+// check clock_gettime() and nanosleep(), and time them.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/time.h"
+#include "user/user.h"
+
+#define NSLEEPER 8
+
+void
+fail(char *s)
+{
+  printf("clocktest: %s\n", s);
+  exit(1);
+}
+
+// sleep(n) takes n ticks, or a little more.
+void
+duration(void)
+{
+  int n, t0, t;
+
+  for(n = 1; n <= 4; n++){
+    t0 = uptime();
+    if(sleep(n) < 0)
+      fail("sleep failed");
+    t = uptime() - t0;
+    if(t < n || t > n + 1){
+      printf("clocktest: sleep(%d) took %d ticks\n", n, t);
+      exit(1);
+    }
+  }
+  if(sleep(0) < 0)
+    fail("sleep(0) failed");
+  printf("clocktest: duration OK\n");
+}
+
+// Sleepers with deadlines in mixed order, some further
+// off than a turn of the wheel, each wake on time.
+void
+sleepers(void)
+{
+  int i, t0, pid, xstatus;
+
+  t0 = uptime();
+  for(i = 0; i < NSLEEPER; i++){
+    pid = fork();
+    if(pid < 0)
+      fail("fork failed");
+    if(pid == 0){
+      int n = (i * 5) % NSLEEPER + 1;
+      sleep(n);
+      exit(uptime() - t0 < n ? 1 : 0);
+    }
+  }
+  for(i = 0; i < NSLEEPER; i++){
+    if(wait(&xstatus) < 0)
+      fail("wait failed");
+    if(xstatus != 0)
+      fail("a sleeper woke early");
+  }
+  if(uptime() - t0 > NSLEEPER + 2)
+    fail("sleepers woke late");
+  printf("clocktest: sleepers OK\n");
+}
+
+// While everything sleeps, harts should be left alone.
+void
+idle(void)
+{
+  uint64 intr0, intr;
+  int nhart, n = 20;
+
+  nhart = statlines("clock cpu");
+  intr0 = statfield("clock cpu", "intr");
+  sleep(n);
+  intr = statfield("clock cpu", "intr") - intr0;
+  printf("clocktest: %d timer interrupts on %d harts in %d idle ticks\n",
+         (int)intr, nhart, n);
+  if(intr >= n * nhart)
+    fail("as many timer interrupts as with a fixed tick");
+  printf("clocktest: idle OK\n");
+}
+
+// nanosleep() for a range of short times, each of which
+// should take at least as long, and not a whole tick more.
+void
+nanosleeps(void)
+{
+  struct timespec ts;
+  uint64 t0, t, us;
+  int i;
+
+  if(clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+    fail("clock_gettime failed");
+  if(ts.nsec >= 1000000000)
+    fail("clock_gettime gave too many nanoseconds");
+  if(clock_gettime(1, &ts) >= 0)
+    fail("clock_gettime of an unknown clock succeeded");
+  ts.sec = 0;
+  ts.nsec = 1000000000;
+  if(nanosleep(&ts) >= 0)
+    fail("nanosleep of a bad timespec succeeded");
+
+  for(us = 100; us <= 20000; us *= 2){
+    ts.sec = 0;
+    ts.nsec = us * 1000;
+    t0 = usecs();
+    if(nanosleep(&ts) < 0)
+      fail("nanosleep failed");
+    t = usecs() - t0;
+    if(t < us || t > us + 100000){
+      printf("clocktest: nanosleep(%d us) took %d us\n", (int)us, (int)t);
+      exit(1);
+    }
+  }
+
+  // time goes forwards, by small steps.
+  t0 = usecs();
+  for(i = 0; i < 1000; i++){
+    t = usecs();
+    if(t < t0)
+      fail("clock_gettime went backwards");
+    t0 = t;
+  }
+  printf("clocktest: nanosleep OK\n");
+}
+
+// How long clock_gettime() and uptime() take.
+void
+speed(void)
+{
+  uint64 t0, t1, t2;
+  int i, n = 10000;
+
+  t0 = usecs();
+  for(i = 0; i < n; i++)
+    usecs();
+  t1 = usecs();
+  for(i = 0; i < n; i++)
+    uptime();
+  t2 = usecs();
+  printf("clocktest: clock_gettime %d ns, uptime %d ns\n",
+         (int)((t1 - t0) * 1000 / n), (int)((t2 - t1) * 1000 / n));
+}
+
+int
+main(int argc, char *argv[])
+{
+  duration();
+  sleepers();
+  idle();
+  nanosleeps();
+  speed();
+  printf("clocktest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,110 @@
+//
+// Measure how fast the kernel copies to and from user memory:
+// large pipe writes and reads, re-reads of a file that stays
+// in the buffer cache, and path names copied in by open().
+// Compare a normal kernel, which copies directly through the
+// process's kernel page table, against one built with
+// make NOUCOPY=1.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define BUFSZ   (16*1024)
+#define PIPEMB  4
+#define NREREAD 200
+#define NOPEN   5000
+
+char buf[BUFSZ];
+
+void
+pipes(void)
+{
+  int fds[2], pid, i, n, t0;
+
+  if(pipe(fds) < 0){
+    printf("copybench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf("copybench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(i = 0; i < PIPEMB*1024*1024/BUFSZ; i++)
+      if(write(fds[1], buf, BUFSZ) != BUFSZ)
+        exit(1);
+    exit(0);
+  }
+  close(fds[1]);
+  while((n = read(fds[0], buf, BUFSZ)) > 0)
+    ;
+  close(fds[0]);
+  wait(0);
+  printf("pipe: %d MB in %d ticks\n", PIPEMB, uptime() - t0);
+}
+
+void
+rereads(void)
+{
+  char *f = "copybench.tmp";
+  int fd, i, t0;
+
+  // small enough to stay in the buffer cache.
+  unlink(f);
+  fd = open(f, O_CREATE|O_WRONLY);
+  if(fd < 0 || write(fd, buf, (NBUF/2)*BSIZE) != (NBUF/2)*BSIZE){
+    printf("copybench: create failed\n");
+    exit(1);
+  }
+  close(fd);
+
+  t0 = uptime();
+  for(i = 0; i < NREREAD; i++){
+    fd = open(f, O_RDONLY);
+    if(read(fd, buf, BUFSZ) != (NBUF/2)*BSIZE){
+      printf("copybench: read failed\n");
+      exit(1);
+    }
+    close(fd);
+  }
+  printf("file: %d reads of %d KB in %d ticks\n",
+         NREREAD, (NBUF/2)*BSIZE/1024, uptime() - t0);
+  unlink(f);
+}
+
+void
+paths(void)
+{
+  char path[MAXPATH];
+  int i, t0;
+
+  // a long name that does not exist; open() copies it in
+  // with copyinstr() and fails at the first lookup.
+  memset(path, 'x', MAXPATH-1);
+  path[MAXPATH-1] = 0;
+  t0 = uptime();
+  for(i = 0; i < NOPEN; i++)
+    if(open(path, O_RDONLY) >= 0){
+      printf("copybench: open succeeded\n");
+      exit(1);
+    }
+  printf("path: %d opens of %d-byte names in %d ticks\n", NOPEN, MAXPATH-1, uptime() - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  pipes();
+  rereads();
+  paths();
+  printf("copybench: OK\n");
+  exit(0);
+}
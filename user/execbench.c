@@ -0,0 +1,60 @@
+//
+// Time how long programs take to start: fork() and exec()
+// a small and a large program many times, each of which exits
+// almost at once. usertests is run with a bad flag, so that it
+// prints its usage message (to a closed fd) and exits.
+// Compare a normal kernel, which reads programs in on demand,
+// against one built with make EAGEREXEC=1.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define N 100
+
+void
+bench(char *path, char **argv)
+{
+  struct stat st;
+  int i, pid, t0, xstatus;
+
+  if(stat(path, &st) < 0){
+    printf("execbench: cannot stat %s\n", path);
+    exit(1);
+  }
+  t0 = uptime();
+  for(i = 0; i < N; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("execbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(1);
+      close(2);
+      exec(path, argv);
+      exit(2);
+    }
+    wait(&xstatus);
+    if(xstatus == 2){
+      printf("execbench: exec %s failed\n", path);
+      exit(1);
+    }
+  }
+  printf("%s (%l bytes): %d starts in %d ticks\n", path, st.size, N, uptime() - t0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *echoargv[] = { "echo", 0 };
+  char *usertestsargv[] = { "usertests", "-x", 0 };
+
+  bench("echo", echoargv);
+  bench("usertests", usertestsargv);
+  printf("execbench: OK\n");
+  exit(0);
+}
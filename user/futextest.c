@@ -0,0 +1,315 @@
+//
+// Test futex_wait() and futex_wake(), and the mutexes and
+// condition variables of user/usync.c built on them, between
+// threads, also across a fork(), and between processes
+// sharing a memory segment. Then time how long a futex takes
+// to hand control from one thread to another, and compare a
+// pipe.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define STACKSZ 4096
+#define NTHREAD 4
+#define NINCR   2000    // increments per thread
+#define NITEM   1000    // items through the bounded buffer
+#define NSLOT   4       // its size
+#define NROUND  2000    // hand-offs timed
+
+int word;
+int forkword;
+int count;
+struct mutex mu;
+struct cond notempty, notfull;
+int buf[NSLOT], head, tail, total;
+int turn;
+int fds[2][2];
+
+void
+fail(char *s)
+{
+  printf("futextest: %s\n", s);
+  exit(1);
+}
+
+void
+start(void (*fn)(void*), void *arg)
+{
+  char *stack;
+
+  if((stack = malloc(STACKSZ)) == 0)
+    fail("malloc failed");
+  if(clone(fn, arg, stack + STACKSZ) < 0)
+    fail("clone failed");
+}
+
+void
+reap(int n)
+{
+  void *stack;
+
+  while(n-- > 0){
+    if(join(&stack) < 0)
+      fail("join failed");
+    free((char*)stack - STACKSZ);
+  }
+}
+
+void
+waiter(void *arg)
+{
+  while(__atomic_load_n(&word, __ATOMIC_ACQUIRE) == 0)
+    futex_wait(&word, 0);
+  exit(0);
+}
+
+// futex_wait() returns at once if the word has changed,
+// and sleeps until futex_wake() if it has not.
+void
+basic(void)
+{
+  int n;
+
+  if(futex_wait(&word, 1) >= 0)
+    fail("futex_wait of a changed word slept");
+  if(futex_wait((int*)((char*)&word + 1), 0) >= 0)
+    fail("futex_wait of a misaligned word succeeded");
+  if(futex_wake(&word, 1) != 0)
+    fail("futex_wake woke someone");
+
+  start(waiter, 0);
+  start(waiter, 0);
+  sleep(1);
+  __atomic_store_n(&word, 1, __ATOMIC_RELEASE);
+  n = futex_wake(&word, NPROC);
+  reap(2);
+  if(n > 2)
+    fail("futex_wake woke too many");
+  printf("futextest: basic OK\n");
+}
+
+void
+incr(void *arg)
+{
+  for(int i = 0; i < NINCR; i++){
+    mutex_lock(&mu);
+    count = count + 1;
+    mutex_unlock(&mu);
+  }
+  exit(0);
+}
+
+// A mutex keeps increments of a plain int from being lost.
+void
+mutex(void)
+{
+  mutex_init(&mu);
+  count = 0;
+  for(int i = 0; i < NTHREAD; i++)
+    start(incr, 0);
+  reap(NTHREAD);
+  if(count != NTHREAD * NINCR)
+    fail("lost increments under a mutex");
+  if(!mutex_trylock(&mu) || mutex_trylock(&mu))
+    fail("mutex_trylock");
+  mutex_unlock(&mu);
+  printf("futextest: mutex OK\n");
+}
+
+void
+producer(void *arg)
+{
+  for(int i = 1; i <= NITEM; i++){
+    mutex_lock(&mu);
+    while(tail - head == NSLOT)
+      cond_wait(&notfull, &mu);
+    buf[tail++ % NSLOT] = i;
+    cond_signal(&notempty);
+    mutex_unlock(&mu);
+  }
+  exit(0);
+}
+
+void
+consumer(void *arg)
+{
+  for(int i = 1; i <= NITEM; i++){
+    mutex_lock(&mu);
+    while(tail == head)
+      cond_wait(&notempty, &mu);
+    total += buf[head++ % NSLOT];
+    cond_signal(&notfull);
+    mutex_unlock(&mu);
+  }
+  exit(0);
+}
+
+// Two producers and two consumers through a bounded buffer.
+void
+cond(void)
+{
+  mutex_init(&mu);
+  cond_init(&notempty);
+  cond_init(&notfull);
+  start(producer, 0);
+  start(producer, 0);
+  start(consumer, 0);
+  start(consumer, 0);
+  reap(4);
+  if(total != NITEM * (NITEM + 1))
+    fail("items went missing through the buffer");
+  printf("futextest: cond OK\n");
+}
+
+// Processes that map the same segment share a mutex in it.
+void
+shared(void)
+{
+  struct mutex *m;
+  int *n, fd, pid, xstatus;
+  char *p;
+
+  if((fd = shmopen(0, 4096, O_RDWR)) < 0)
+    fail("shmopen failed");
+  p = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    fail("mmap failed");
+  close(fd);
+  m = (struct mutex*)p;
+  n = (int*)(p + 64);
+  mutex_init(m);
+  *n = 0;
+
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  for(int i = 0; i < NINCR; i++){
+    mutex_lock(m);
+    *n = *n + 1;
+    mutex_unlock(m);
+  }
+  if(pid == 0)
+    exit(0);
+  if(wait(&xstatus) != pid || xstatus != 0)
+    fail("child failed");
+  if(*n != 2 * NINCR)
+    fail("lost increments under a shared mutex");
+  munmap(p, 4096);
+  printf("futextest: shared OK\n");
+}
+
+void
+forkwaiter(void *arg)
+{
+  while(__atomic_load_n(&forkword, __ATOMIC_ACQUIRE) == 0)
+    futex_wait(&forkword, 0);
+  exit(0);
+}
+
+// A fork() while a thread waits makes the page of the word
+// copy-on-write, and the store that sets it moves it to a new
+// physical page; futex_wake() must still find the waiter.
+void
+forked(void)
+{
+  int pid, xstatus, n;
+
+  start(forkwaiter, 0);
+  sleep(1);
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    sleep(5);
+    exit(0);
+  }
+  __atomic_store_n(&forkword, 1, __ATOMIC_RELEASE);
+  n = futex_wake(&forkword, 1);
+  if(n != 1)
+    fail("futex_wake after fork() missed its waiter");
+  reap(1);
+  if(wait(&xstatus) != pid || xstatus != 0)
+    fail("child failed");
+  printf("futextest: fork OK\n");
+}
+
+// Take turns with the main thread through the futex word
+// turn: wait for it to be 1, set it to 0, and wake.
+void
+pong(void *arg)
+{
+  for(int i = 0; i < NROUND; i++){
+    while(__atomic_load_n(&turn, __ATOMIC_ACQUIRE) != 1)
+      futex_wait(&turn, 0);
+    __atomic_store_n(&turn, 0, __ATOMIC_RELEASE);
+    futex_wake(&turn, 1);
+  }
+  exit(0);
+}
+
+void
+pipepong(void *arg)
+{
+  char c;
+
+  for(int i = 0; i < NROUND; i++){
+    if(read(fds[0][0], &c, 1) != 1 || write(fds[1][1], &c, 1) != 1)
+      exit(1);
+  }
+  exit(0);
+}
+
+// Round trips between two threads, through a futex
+// and through a pair of pipes.
+void
+latency(void)
+{
+  uint64 t0, tf, tp;
+  char c = 'x';
+
+  turn = 0;
+  start(pong, 0);
+  t0 = usecs();
+  for(int i = 0; i < NROUND; i++){
+    __atomic_store_n(&turn, 1, __ATOMIC_RELEASE);
+    futex_wake(&turn, 1);
+    while(__atomic_load_n(&turn, __ATOMIC_ACQUIRE) != 0)
+      futex_wait(&turn, 1);
+  }
+  tf = usecs() - t0;
+  reap(1);
+
+  if(pipe(fds[0]) < 0 || pipe(fds[1]) < 0)
+    fail("pipe failed");
+  start(pipepong, 0);
+  t0 = usecs();
+  for(int i = 0; i < NROUND; i++){
+    if(write(fds[0][1], &c, 1) != 1 || read(fds[1][0], &c, 1) != 1)
+      fail("pipe round trip failed");
+  }
+  tp = usecs() - t0;
+  reap(1);
+  for(int i = 0; i < 2; i++){
+    close(fds[i][0]);
+    close(fds[i][1]);
+  }
+  printf("futextest: round trip: futex %d us, pipe %d us\n",
+         (int)(tf / NROUND), (int)(tp / NROUND));
+}
+
+int
+main(int argc, char *argv[])
+{
+  basic();
+  mutex();
+  cond();
+  shared();
+  forked();
+  latency();
+  printf("futextest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,72 @@
+//
+// Stress the physical page allocator from several processes at
+// once and report how often they contended for the per-CPU kmem
+// locks and how many pages had to be stolen between CPUs.
+// Run with make CPUS=1..8 qemu to see how it scales.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NCHILD 4
+#define N      20000
+
+void
+churn(void)
+{
+  char *a;
+
+  for(int i = 0; i < N; i++){
+    a = sbrk(PGSIZE);
+    if(a == (char*)-1){
+      printf("kalloctest: sbrk failed\n");
+      exit(1);
+    }
+    *(int *)(a + 4) = 1;
+    a = sbrk(-PGSIZE);
+    if(a == (char*)-1){
+      printf("kalloctest: sbrk(-) failed\n");
+      exit(1);
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 contend0, steal0;
+  int t0, pid, i;
+
+  printf("start kalloctest\n");
+  contend0 = statfield("kmem cpu", "contend");
+  steal0 = statfield("kmem cpu", "steal");
+  t0 = uptime();
+
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("kalloctest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      churn();
+      exit(0);
+    }
+  }
+
+  for(i = 0; i < NCHILD; i++){
+    int xstatus;
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+
+  printf("%d children x %d allocations: %d ticks\n", NCHILD, N, uptime() - t0);
+  printf("kmem lock contention: %l\n", statfield("kmem cpu", "contend") - contend0);
+  printf("pages stolen between cpus: %l\n", statfield("kmem cpu", "steal") - steal0);
+  printf("kalloctest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,55 @@
+//
+// Measure the kernel direct map: print the kernel page table's
+// footprint and software walk cost from the statistics device,
+// then time fork()s of a large process, which copy its memory
+// through the direct map. Compare a normal kernel against one
+// built with make NOMEGAPAGE=1.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NPAGE   2048   // 8 MB
+#define NFORK   20
+
+int
+main(int argc, char *argv[])
+{
+  char *a;
+  int i, j, t0, pid, xstatus;
+
+  printf("start kvmbench\n");
+  printstat("kvm:");
+
+  a = sbrk(NPAGE * PGSIZE);
+  if(a == (char*)-1){
+    printf("kvmbench: sbrk failed\n");
+    exit(1);
+  }
+  for(j = 0; j < NPAGE; j++)
+    a[j * PGSIZE] = j;
+
+  t0 = uptime();
+  for(i = 0; i < NFORK; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("kvmbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      // write every page, so it is copied even with copy-on-write.
+      for(j = 0; j < NPAGE; j++)
+        a[j * PGSIZE] += 1;
+      exit(0);
+    }
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  printf("%d forks of %d pages: %d ticks\n", NFORK, NPAGE, uptime() - t0);
+  printf("kvmbench: OK\n");
+  exit(0);
+}
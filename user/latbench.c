@@ -0,0 +1,91 @@
+//
+// Latency of a short interactive job under CPU-bound load.
+// Starts some processes that spin, then many times sleeps,
+// wakes and forks and reaps a child, which is about what a
+// shell does for a command, and reports the median and worst
+// times taken, in microseconds. Compare a kernel built with
+// make MLFQ=1, which should keep the interactive process
+// ahead of the spinners, with the default round robin.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NJOB 30
+
+void
+fail(char *s)
+{
+  printf("latbench: %s\n", s);
+  exit(1);
+}
+
+void
+priorities(void)
+{
+  int pid = getpid();
+
+  if(getpriority(pid) < 0)
+    fail("getpriority failed");
+  if(setpriority(pid, NPRIO) >= 0 || setpriority(pid, -1) >= 0)
+    fail("setpriority accepted a bad level");
+  if(setpriority(pid, NPRIO-1) < 0 || getpriority(pid) != NPRIO-1)
+    fail("setpriority did not take");
+  if(setpriority(pid, 0) < 0)
+    fail("setpriority failed");
+  if(getpriority(-1) >= 0 || setpriority(-1, 0) >= 0)
+    fail("found a process with pid -1");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int hogs[NPROC], t[NJOB];
+  int i, j, n, pid, tmp;
+  uint64 t0;
+
+  priorities();
+
+  n = 6;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 0 || n > NPROC / 2)
+    fail("usage: latbench [spinners]");
+
+  for(i = 0; i < n; i++){
+    if((hogs[i] = fork()) < 0)
+      fail("fork failed");
+    if(hogs[i] == 0)
+      for(;;)
+        ;
+  }
+
+  for(i = 0; i < NJOB; i++){
+    sleep(1);
+    t0 = usecs();
+    if((pid = fork()) < 0)
+      fail("fork failed");
+    if(pid == 0)
+      exit(0);
+    wait(0);
+    t[i] = usecs() - t0;
+  }
+
+  for(i = 0; i < n; i++){
+    kill(hogs[i]);
+    wait(0);
+  }
+
+  // insertion sort, for the median and the worst.
+  for(i = 1; i < NJOB; i++)
+    for(j = i; j > 0 && t[j-1] > t[j]; j--){
+      tmp = t[j];
+      t[j] = t[j-1];
+      t[j-1] = tmp;
+    }
+  printf("latbench: %d spinners, %d jobs: median %d us, worst %d us\n",
+         n, NJOB, t[NJOB/2], t[NJOB-1]);
+  exit(0);
+}
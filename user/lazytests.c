@@ -0,0 +1,188 @@
+//
+// tests for lazy (demand-zero) sbrk.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+// more than the 128 MB of RAM, but within the 192 MB of
+// user address space below UVMTOP (kernel/memlayout.h).
+#define REGION_SZ (160 * 1024 * 1024)
+
+// reserve far more than physical memory, and touch
+// only a sparse subset of it.
+void
+sparse_memory(char *s)
+{
+  char *i, *prev_end, *new_end;
+
+  prev_end = sbrk(REGION_SZ);
+  if(prev_end == (char*)0xffffffffffffffffL){
+    printf("sbrk() failed\n");
+    exit(1);
+  }
+  new_end = prev_end + REGION_SZ;
+
+  for(i = prev_end + PGSIZE; i < new_end; i += 64 * PGSIZE)
+    *(char **)i = i;
+
+  for(i = prev_end + PGSIZE; i < new_end; i += 64 * PGSIZE){
+    if(*(char **)i != i){
+      printf("failed to read value from memory\n");
+      exit(1);
+    }
+  }
+
+  exit(0);
+}
+
+// after sbrk() gives memory back, touching it must fault.
+void
+sparse_memory_unmap(char *s)
+{
+  int pid;
+  char *i, *prev_end, *new_end;
+
+  prev_end = sbrk(REGION_SZ);
+  if(prev_end == (char*)0xffffffffffffffffL){
+    printf("sbrk() failed\n");
+    exit(1);
+  }
+  new_end = prev_end + REGION_SZ;
+
+  for(i = prev_end + PGSIZE; i < new_end; i += PGSIZE * PGSIZE)
+    *(char **)i = i;
+
+  for(i = prev_end + PGSIZE; i < new_end; i += PGSIZE * PGSIZE){
+    pid = fork();
+    if(pid < 0){
+      printf("error forking\n");
+      exit(1);
+    } else if(pid == 0){
+      sbrk(-1L * REGION_SZ);
+      *(char **)i = i;
+      exit(0);
+    } else {
+      int status;
+      wait(&status);
+      if(status == 0){
+        printf("memory not unmapped\n");
+        exit(1);
+      }
+    }
+  }
+
+  exit(0);
+}
+
+// touching more memory than exists must kill
+// the process, not the kernel.
+void
+oom(char *s)
+{
+  void *m1, *m2;
+  int pid;
+
+  if((pid = fork()) == 0){
+    m1 = 0;
+    while((m2 = malloc(4096*4096)) != 0){
+      for(char *q = m2; q < (char*)m2 + 4096*4096; q += PGSIZE)
+        *q = 1;
+      *(char**)m2 = m1;
+      m1 = m2;
+    }
+    exit(0);
+  } else {
+    int xstatus;
+    wait(&xstatus);
+    exit(xstatus == 0);
+  }
+}
+
+// a huge sbrk() should cost about as much as a small one.
+void
+sbrk_latency(char *s)
+{
+  int t0, t1;
+  char *a;
+
+  t0 = uptime();
+  for(int i = 0; i < 100; i++){
+    a = sbrk(REGION_SZ);
+    if(a == (char*)0xffffffffffffffffL){
+      printf("sbrk() failed\n");
+      exit(1);
+    }
+    a[REGION_SZ - 1] = 1;
+    if(sbrk(-REGION_SZ) == (char*)0xffffffffffffffffL){
+      printf("sbrk(-) failed\n");
+      exit(1);
+    }
+  }
+  t1 = uptime();
+  printf("100 x sbrk(%d) in %d ticks ", REGION_SZ, t1 - t0);
+  exit(0);
+}
+
+// run each test in its own process. run the test with
+// the name argv[1] if it is not null.
+int
+run(void f(char *), char *s) {
+  int pid;
+  int xstatus;
+  
+  printf("running test %s\n", s);
+  if((pid = fork()) < 0) {
+    printf("runtest: fork error\n");
+    exit(1);
+  }
+  if(pid == 0) {
+    f(s);
+    exit(0);
+  } else {
+    wait(&xstatus);
+    if(xstatus != 0) 
+      printf("test %s: FAILED\n", s);
+    else
+      printf("test %s: OK\n", s);
+    return xstatus == 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *n = 0;
+  if(argc > 1) {
+    n = argv[1];
+  }
+  
+  struct test {
+    void (*f)(char *);
+    char *s;
+  } tests[] = {
+    { sparse_memory, "lazy alloc"},
+    { sparse_memory_unmap, "lazy unmap"},
+    { oom, "out of memory"},
+    { sbrk_latency, "sbrk latency"},
+    { 0, 0},
+  };
+    
+  printf("lazytests starting\n");
+
+  int fail = 0;
+  for (struct test *t = tests; t->s != 0; t++) {
+    if((n == 0) || strcmp(t->s, n) == 0) {
+      if(!run(t->f, t->s))
+        fail = 1;
+    }
+  }
+  if(!fail)
+    printf("ALL TESTS PASSED\n");
+  else
+    printf("SOME TESTS FAILED\n");
+  exit(fail);
+}
@@ -0,0 +1,115 @@
+//
+// Print the hottest kernel spinlocks: those that harts spent
+// longest spinning for, with how often each was acquired and
+// how often it was already held. Locks of the same name, such
+// as every process's p->lock, are added up. Given a command,
+// run it and print what the locks did meanwhile:
+//   lockstat kalloctest
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+#define NLOCK 1024   // most locks read
+#define NTOP  12     // names printed
+
+struct lockstat locks[NLOCK];
+struct lockstat before[NLOCK], after[NLOCK];
+
+void
+fail(char *s)
+{
+  fprintf(2, "lockstat: %s\n", s);
+  exit(1);
+}
+
+// Read the kernel's locks and add them up by name
+// into sum, returning the number of names.
+int
+collect(struct lockstat *sum)
+{
+  int i, j, n, nsum;
+
+  if((n = lockstat(locks, NLOCK)) < 0)
+    fail("lockstat failed");
+  if(n > NLOCK)
+    n = NLOCK;
+  nsum = 0;
+  for(i = 0; i < n; i++){
+    for(j = 0; j < nsum; j++)
+      if(strcmp(sum[j].name, locks[i].name) == 0)
+        break;
+    if(j == nsum){
+      sum[nsum] = locks[i];
+      nsum++;
+      continue;
+    }
+    sum[j].nacquire += locks[i].nacquire;
+    sum[j].ncontend += locks[i].ncontend;
+    sum[j].nspin += locks[i].nspin;
+  }
+  return nsum;
+}
+
+// Subtract the counts in old from those in sum, by name.
+void
+subtract(struct lockstat *sum, int n, struct lockstat *old, int nold)
+{
+  for(int i = 0; i < n; i++){
+    for(int j = 0; j < nold; j++){
+      if(strcmp(sum[i].name, old[j].name) == 0){
+        sum[i].nacquire -= old[j].nacquire;
+        sum[i].ncontend -= old[j].ncontend;
+        sum[i].nspin -= old[j].nspin;
+        break;
+      }
+    }
+  }
+}
+
+void
+print(struct lockstat *sum, int n)
+{
+  struct lockstat tmp;
+  int i, j;
+
+  // insertion sort, most spins first.
+  for(i = 1; i < n; i++)
+    for(j = i; j > 0 && sum[j-1].nspin < sum[j].nspin; j--){
+      tmp = sum[j];
+      sum[j] = sum[j-1];
+      sum[j-1] = tmp;
+    }
+  printf("%s\t%s\t%s\t%s\t%s\n", "lock", "kind", "acquire", "contend", "spin");
+  for(i = 0; i < n && i < NTOP; i++)
+    printf("%s\t%s\t%l\t%l\t%l\n", sum[i].name, sum[i].isticket ? "ticket" : "tas",
+           sum[i].nacquire, sum[i].ncontend, sum[i].nspin);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, nbefore, pid;
+
+  if(argc < 2){
+    n = collect(after);
+    print(after, n);
+    exit(0);
+  }
+
+  nbefore = collect(before);
+  if((pid = fork()) < 0)
+    fail("fork failed");
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    fail("exec failed");
+  }
+  wait(0);
+  n = collect(after);
+  subtract(after, n, before, nbefore);
+  print(after, n);
+  exit(0);
+}
@@ -0,0 +1,278 @@
+//
+// tests for mmap() and munmap() of files.
+//
+
+#include "kernel/param.h"
+#include "kernel/fcntl.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+char *testname = "???";
+
+void
+err(char *why)
+{
+  printf("mmaptest: %s failed: %s, pid=%d\n", testname, why, getpid());
+  exit(1);
+}
+
+char buf[BSIZE];
+
+// fill a file with 1.5 pages of 'A' and 'B'.
+void
+makefile(const char *f)
+{
+  int i;
+  int n = PGSIZE/BSIZE;
+
+  unlink(f);
+  int fd = open(f, O_WRONLY | O_CREATE);
+  if(fd == -1)
+    err("open");
+  memset(buf, 'A', BSIZE);
+  // write 1.5 page
+  for(i = 0; i < n + n/2; i++){
+    if(i == n)
+      memset(buf, 'B', BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE)
+      err("write 0 makefile");
+  }
+  if(close(fd) == -1)
+    err("close");
+}
+
+// check that the first 1.5 pages at p hold the contents
+// written by makefile(), and the rest of the page is zero.
+void
+checkmapped(char *p, char *s)
+{
+  int i;
+
+  for(i = 0; i < PGSIZE; i++)
+    if(p[i] != 'A')
+      err(s);
+  for(; i < PGSIZE + PGSIZE/2; i++)
+    if(p[i] != 'B')
+      err(s);
+  for(; i < 2*PGSIZE; i++)
+    if(p[i] != 0)
+      err(s);
+}
+
+void
+readtest(void)
+{
+  const char * const f = "mmap.dur";
+
+  testname = "read";
+  makefile(f);
+  int fd = open(f, O_RDONLY);
+  if(fd == -1)
+    err("open");
+
+  char *p = mmap(0, PGSIZE*2, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1)
+    err("mmap (1)");
+  close(fd);
+  checkmapped(p, "mmap (2)");
+  if(munmap(p, PGSIZE*2) == -1)
+    err("munmap (1)");
+
+  // mapping a read-only file shared and writable must fail.
+  fd = open(f, O_RDONLY);
+  p = mmap(0, PGSIZE*3, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p != (char*)-1)
+    err("mmap call should have failed");
+  close(fd);
+  printf("%s: OK\n", testname);
+}
+
+void
+privatetest(void)
+{
+  const char * const f = "mmap.dur";
+  int i;
+
+  testname = "private";
+  makefile(f);
+  int fd = open(f, O_RDWR);
+  if(fd == -1)
+    err("open");
+  char *p = mmap(0, PGSIZE*2, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1)
+    err("mmap");
+  close(fd);
+  for(i = 0; i < PGSIZE*2; i++)
+    p[i] = 'Z';
+  if(munmap(p, PGSIZE*2) == -1)
+    err("munmap");
+
+  // the file must be unchanged.
+  fd = open(f, O_RDONLY);
+  if(read(fd, buf, BSIZE) != BSIZE || buf[0] != 'A')
+    err("private write reached the file");
+  close(fd);
+  printf("%s: OK\n", testname);
+}
+
+void
+sharedtest(void)
+{
+  const char * const f = "mmap.dur";
+  int i;
+
+  testname = "shared";
+  makefile(f);
+  int fd = open(f, O_RDWR);
+  if(fd == -1)
+    err("open");
+  char *p = mmap(0, PGSIZE*2, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    err("mmap");
+  close(fd);
+
+  // read() into the mapping writes it from the kernel.
+  fd = open("README", O_RDONLY);
+  if(fd < 0 || read(fd, p + PGSIZE, 16) != 16)
+    err("read into mapping");
+  close(fd);
+  for(i = 0; i < PGSIZE; i++)
+    p[i] = 'Z';
+
+  // unmap the first page, then the second.
+  if(munmap(p, PGSIZE) == -1)
+    err("munmap (1)");
+  if(munmap(p + PGSIZE, PGSIZE) == -1)
+    err("munmap (2)");
+  if(munmap(p, PGSIZE) != -1)
+    err("munmap of unmapped memory should fail");
+
+  fd = open(f, O_RDONLY);
+  for(i = 0; i < PGSIZE/BSIZE + PGSIZE/BSIZE/2; i++){
+    if(read(fd, buf, BSIZE) != BSIZE)
+      err("read back");
+    if(i < PGSIZE/BSIZE && buf[0] != 'Z')
+      err("first page not written back");
+    if(i == PGSIZE/BSIZE && buf[0] == 'B')
+      err("second page not written back");
+  }
+  // write back must not have grown the file.
+  if(read(fd, buf, BSIZE) != 0)
+    err("file grew");
+  close(fd);
+  printf("%s: OK\n", testname);
+}
+
+void
+forktest(void)
+{
+  const char * const f = "mmap.dur";
+  int pid, xstatus;
+
+  testname = "fork";
+  makefile(f);
+  int fd = open(f, O_RDWR);
+  if(fd == -1)
+    err("open");
+  char *p1 = mmap(0, PGSIZE*2, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  char *p2 = mmap(0, PGSIZE*2, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p1 == (char*)-1 || p2 == (char*)-1)
+    err("mmap");
+  close(fd);
+
+  // touch one page of each in the parent only.
+  if(p1[0] != 'A' || p2[0] != 'A')
+    err("read");
+
+  if((pid = fork()) < 0)
+    err("fork");
+  if(pid == 0){
+    checkmapped(p1, "child shared");
+    checkmapped(p2, "child private");
+    p1[1] = 'S';
+    p2[1] = 'P';
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+
+  if(p1[1] != 'S')
+    err("child's shared write not seen");
+  if(p2[1] != 'A')
+    err("child's private write seen");
+  if(munmap(p1, PGSIZE*2) == -1 || munmap(p2, PGSIZE*2) == -1)
+    err("munmap");
+  printf("%s: OK\n", testname);
+}
+
+// compare scanning a file with read() against
+// scanning a mapping of it.
+void
+benchmark(void)
+{
+  const char * const f = "mmap.bench";
+  enum { NBLOCK = 64, NPASS = 50 };
+  int fd, i, j, pass, t0, tread, tmmap;
+  uint sum1, sum2;
+  char *p;
+
+  testname = "benchmark";
+  unlink(f);
+  fd = open(f, O_WRONLY | O_CREATE);
+  for(i = 0; i < NBLOCK; i++){
+    memset(buf, i, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE)
+      err("write");
+  }
+  close(fd);
+
+  // read one byte from every block, NPASS times.
+  sum1 = 0;
+  t0 = uptime();
+  for(pass = 0; pass < NPASS; pass++){
+    fd = open(f, O_RDONLY);
+    for(i = 0; i < NBLOCK; i++){
+      if(read(fd, buf, BSIZE) != BSIZE)
+        err("read");
+      sum1 += buf[(i * 37) % BSIZE];
+    }
+    close(fd);
+  }
+  tread = uptime() - t0;
+
+  sum2 = 0;
+  t0 = uptime();
+  fd = open(f, O_RDONLY);
+  p = mmap(0, NBLOCK*BSIZE, PROT_READ, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    err("mmap");
+  close(fd);
+  for(pass = 0; pass < NPASS; pass++)
+    for(j = 0; j < NBLOCK; j++)
+      sum2 += p[j*BSIZE + (j * 37) % BSIZE];
+  munmap(p, NBLOCK*BSIZE);
+  tmmap = uptime() - t0;
+
+  if(sum1 != sum2)
+    err("different data");
+  unlink(f);
+  printf("%s: %d passes over %d blocks: read %d ticks, mmap %d ticks\n",
+         testname, NPASS, NBLOCK, tread, tmmap);
+}
+
+int
+main(int argc, char *argv[])
+{
+  readtest();
+  privatetest();
+  sharedtest();
+  forktest();
+  benchmark();
+  unlink("mmap.dur");
+  printf("mmaptest: all tests succeeded\n");
+  exit(0);
+}
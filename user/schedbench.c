@@ -0,0 +1,138 @@
+//
+// Scheduler benchmarks: how fast processes can be forked and
+// reaped, and how fast pairs of processes can hand control
+// back and forth through pipes, which puts each through
+// sleep(), wakeup() and a context switch every round.
+// Several forkers and pairs run at once, to keep all harts
+// busy; run it under make CPUS=1 up to CPUS=8 to see how the
+// scheduler scales. Prints the run queue statistics after.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NFORK   200    // forks per forker
+#define NROUND  2000   // round trips per pair
+#define TICKHZ  10     // timer interrupts per second in qemu
+
+void
+fail(char *s)
+{
+  printf("schedbench: %s\n", s);
+  exit(1);
+}
+
+// Wait for n children, all of which must succeed.
+void
+reap(int n)
+{
+  int xstatus;
+
+  while(n-- > 0)
+    if(wait(&xstatus) < 0 || xstatus != 0)
+      fail("child failed");
+}
+
+void
+forker(void)
+{
+  int i, pid;
+
+  for(i = 0; i < NFORK; i++){
+    pid = fork();
+    if(pid < 0)
+      fail("fork failed");
+    if(pid == 0)
+      exit(0);
+    reap(1);
+  }
+}
+
+// One side of a pair: NROUND times, read a byte
+// from in and write it to out. The first side
+// writes to start things off.
+void
+pingpong(int in, int out, int first)
+{
+  char c = 'x';
+  int i;
+
+  if(first && write(out, &c, 1) != 1)
+    fail("write failed");
+  for(i = 0; i < NROUND; i++){
+    if(read(in, &c, 1) != 1)
+      fail("read failed");
+    if((!first || i < NROUND-1) && write(out, &c, 1) != 1)
+      fail("write failed");
+  }
+}
+
+// Start n children each running f, and report
+// how many of what they do got done per second.
+void
+run(char *what, int n, int each, void (*f)(int))
+{
+  int i, pid, t0, t;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    pid = fork();
+    if(pid < 0)
+      fail("fork failed");
+    if(pid == 0){
+      f(i);
+      exit(0);
+    }
+  }
+  reap(n);
+  t = uptime() - t0;
+  if(t == 0)
+    t = 1;
+  printf("schedbench: %d x %d %s in %d ticks, %d per second\n",
+         n, each, what, t, n * each * TICKHZ / t);
+}
+
+void
+forks(int i)
+{
+  forker();
+}
+
+// Each pair is a process and a child of its own.
+void
+pair(int i)
+{
+  int ab[2], ba[2], pid;
+
+  if(pipe(ab) < 0 || pipe(ba) < 0)
+    fail("pipe failed");
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    pingpong(ab[0], ba[1], 0);
+    exit(0);
+  }
+  pingpong(ba[0], ab[1], 1);
+  reap(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n;
+
+  n = 4;
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n < 1 || n > NPROC / 4)
+    fail("usage: schedbench [procs]");
+
+  run("forks", n, NFORK, forks);
+  run("round trips", n, NROUND, pair);
+
+  printstat("runq");
+  exit(0);
+}
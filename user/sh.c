@@ -3,6 +3,7 @@
 #include "kernel/types.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/spawn.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,6 +53,13 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+int simplecmd(char*);
+int spawncmd(struct cmd*);
+void freecmd(struct cmd*);
+
+// Run simple commands with spawn() rather than fork() and
+// exec(); sh -f always forks, for comparison.
+int usespawn = 1;
 
 // Execute cmd.  Never returns.
 void
@@ -142,11 +150,15 @@ getcmd(char *buf, int nbuf)
 }
 
 int
-main(void)
+main(int argc, char *argv[])
 {
   static char buf[100];
+  struct cmd *cmd;
   int fd;
 
+  if(argc > 1 && strcmp(argv[1], "-f") == 0)
+    usespawn = 0;
+
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
     if(fd >= 3){
@@ -164,7 +176,13 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
+    if(usespawn && simplecmd(buf)){
+      // no need to copy the shell just to exec the command.
+      cmd = parsecmd(buf);
+      if(spawncmd(cmd) < 0 && fork1() == 0)
+        runcmd(cmd);  // to say what went wrong
+      freecmd(cmd);
+    } else if(fork1() == 0)
       runcmd(parsecmd(buf));
     wait(0);
   }
@@ -491,3 +509,84 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+//PAGEBREAK!
+// Simple commands
+
+// Whether buf is a single command with at most some
+// redirections, which parsecmd() would accept: it is
+// parsed by the shell itself, so must not make it panic.
+int
+simplecmd(char *buf)
+{
+  char *s, *es;
+  int tok, ntok, nargs;
+
+  s = buf;
+  es = s + strlen(s);
+  ntok = nargs = 0;
+  while((tok = gettoken(&s, es, 0, 0)) != 0){
+    if(++ntok >= MAXARGS)
+      return 0;
+    if(tok == 'a'){
+      nargs++;
+      continue;
+    }
+    if(tok != '<' && tok != '>' && tok != '+')
+      return 0;
+    if(gettoken(&s, es, 0, 0) != 'a')
+      return 0;
+  }
+  return nargs > 0;
+}
+
+// Start the simple command cmd with spawn(), turning its
+// redirections into file actions, applied in the order
+// runcmd() would apply them. Returns the child's pid, or -1.
+int
+spawncmd(struct cmd *cmd)
+{
+  struct spawnact act[MAXARGS];
+  struct redircmd *rcmd;
+  struct execcmd *ecmd;
+  int n;
+
+  n = 0;
+  while(cmd->type == REDIR){
+    rcmd = (struct redircmd*)cmd;
+    act[n].op = SPAWN_OPEN;
+    act[n].fd = rcmd->fd;
+    act[n].arg = rcmd->mode;
+    act[n].path = rcmd->file;
+    n++;
+    cmd = rcmd->cmd;
+  }
+  ecmd = (struct execcmd*)cmd;
+  if(ecmd->argv[0] == 0)
+    return -1;
+  return spawn(ecmd->argv[0], ecmd->argv, act, n);
+}
+
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+  case PIPE:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+  case LIST:
+    freecmd(((struct listcmd*)cmd)->left);
+    freecmd(((struct listcmd*)cmd)->right);
+    break;
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
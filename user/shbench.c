@@ -0,0 +1,172 @@
+//
+// Check spawn()'s file actions, then time the shell running
+// a script of simple commands, with the commands spawn()ed
+// and, for comparison, with sh -f, which forks and execs.
+// The shell's output goes down a pipe that is thrown away.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/spawn.h"
+#include "user/user.h"
+
+#define N 200         // commands in the script
+#define TICKHZ 10     // timer interrupts per second in qemu
+
+char *script = "shbench.sh";
+char *out = "shbench.out";
+
+void
+fail(char *s)
+{
+  printf("shbench: %s\n", s);
+  exit(1);
+}
+
+// Wait for pid, and return its exit status.
+int
+reap(int pid)
+{
+  int xstatus;
+
+  if(pid < 0)
+    fail("spawn failed");
+  if(wait(&xstatus) != pid)
+    fail("wait returned the wrong child");
+  return xstatus;
+}
+
+// Check that out holds exactly s.
+void
+expect(char *s)
+{
+  char buf[64];
+  int fd, n;
+
+  if((fd = open(out, O_RDONLY)) < 0)
+    fail("cannot open output");
+  n = read(fd, buf, sizeof(buf)-1);
+  close(fd);
+  if(n < 0)
+    fail("cannot read output");
+  buf[n] = 0;
+  if(strcmp(buf, s) != 0){
+    printf("shbench: output %s, expected %s\n", buf, s);
+    exit(1);
+  }
+}
+
+void
+actions(void)
+{
+  char *echoargv[] = { "echo", "hello", 0 };
+  char *lsargv[] = { "ls", "nonexistent", 0 };
+  struct spawnact act[2];
+  int fd;
+
+  // open as stdout.
+  act[0].op = SPAWN_OPEN;
+  act[0].fd = 1;
+  act[0].arg = O_WRONLY|O_CREATE|O_TRUNC;
+  act[0].path = out;
+  if(reap(spawn("echo", echoargv, act, 1)) != 0)
+    fail("echo failed");
+  expect("hello\n");
+
+  // stderr made a copy of an opened stdout.
+  act[1].op = SPAWN_DUP2;
+  act[1].fd = 2;
+  act[1].arg = 1;
+  reap(spawn("ls", lsargv, act, 2));
+  expect("ls: cannot open nonexistent\n");
+
+  // the caller's descriptor 3 is closed in the child.
+  if((fd = open(out, O_RDONLY)) != 3)
+    fail("expected to open fd 3");
+  act[0].op = SPAWN_CLOSE;
+  act[0].fd = 3;
+  act[1].op = SPAWN_DUP2;
+  act[1].fd = 1;
+  act[1].arg = 3;
+  if(spawn("echo", echoargv, act, 2) >= 0)
+    fail("dup of a closed descriptor succeeded");
+  close(fd);
+
+  // failures leave no child behind.
+  act[0].op = 99;
+  if(spawn("echo", echoargv, act, 1) >= 0)
+    fail("bad action succeeded");
+  if(spawn("nonexistent", echoargv, 0, 0) >= 0)
+    fail("spawn of a missing program succeeded");
+  if(spawn("echo", echoargv, act, NSPAWNACT+1) >= 0)
+    fail("too many actions succeeded");
+  if(wait(0) != -1)
+    fail("a failed spawn left a child");
+
+  unlink(out);
+  printf("shbench: spawn actions OK\n");
+}
+
+// Run N commands through sh with argument arg,
+// and report how many it managed per second.
+void
+bench(char *arg)
+{
+  char *shargv[] = { "sh", arg, 0 };
+  char buf[512];
+  struct spawnact act[3];
+  int p[2], pid, t0, t;
+
+  if(pipe(p) < 0)
+    fail("pipe failed");
+  act[0].op = SPAWN_OPEN;
+  act[0].fd = 0;
+  act[0].arg = O_RDONLY;
+  act[0].path = script;
+  act[1].op = SPAWN_DUP2;
+  act[1].fd = 1;
+  act[1].arg = p[1];
+  act[2].op = SPAWN_DUP2;
+  act[2].fd = 2;
+  act[2].arg = p[1];
+
+  t0 = uptime();
+  pid = spawn("sh", shargv, act, 3);
+  close(p[1]);
+  while(read(p[0], buf, sizeof(buf)) > 0)
+    ;
+  close(p[0]);
+  if(reap(pid) != 0)
+    fail("sh failed");
+  t = uptime() - t0;
+  if(t == 0)
+    t = 1;
+  printf("sh %s: %d commands in %d ticks, %d per second\n",
+         arg ? arg : "", N, t, N * TICKHZ / t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *line = "echo a b c > shbench.out\n";
+  int fd, i;
+
+  actions();
+
+  if((fd = open(script, O_WRONLY|O_CREATE|O_TRUNC)) < 0)
+    fail("cannot create script");
+  for(i = 0; i < N; i++)
+    if(write(fd, line, strlen(line)) != strlen(line))
+      fail("cannot write script");
+  close(fd);
+
+  bench(0);
+  bench("-f");
+
+  unlink(script);
+  unlink(out);
+  printf("shbench: OK\n");
+  exit(0);
+}
@@ -0,0 +1,240 @@
+//
+// Test shared memory segments: an anonymous one shared with
+// a forked child, and a named one that a child looks up by
+// name, before and after it is unlinked. Check that nothing
+// is left once everyone has closed and unmapped them. Then
+// time moving a megabyte through a pipe and through a
+// segment, with a pipe only to say whose turn it is.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define SZ     8192
+#define CHUNK  (16*PGSIZE)   // bytes moved per turn
+#define TOTAL  (1024*1024)   // bytes moved by each benchmark
+
+char buf[SZ];
+char chunk[CHUNK];
+
+void
+fail(char *s)
+{
+  printf("shmtest: %s\n", s);
+  exit(1);
+}
+
+// Map all size bytes of the segment open as fd.
+char*
+map(int fd, int size, int prot)
+{
+  char *p;
+
+  p = mmap(0, size, prot, MAP_SHARED, fd, 0);
+  if(p == (char*)-1)
+    fail("mmap failed");
+  return p;
+}
+
+void
+reap(void)
+{
+  int xstatus;
+
+  if(wait(&xstatus) < 0 || xstatus != 0)
+    exit(1);
+}
+
+// An anonymous segment, written by a child and read by
+// its parent, both through the child's own mapping made
+// after fork() and through one it inherited.
+void
+anon(void)
+{
+  int fd, pid, size = 4*PGSIZE;
+  char *p, *q;
+
+  if((fd = shmopen(0, size, O_RDWR)) < 0)
+    fail("shmopen of an anonymous segment failed");
+  p = map(fd, size, PROT_READ|PROT_WRITE);
+  if(p[0] != 0 || p[size-1] != 0)
+    fail("new segment not zeroed");
+  if(read(fd, buf, 1) >= 0 || write(fd, buf, 1) >= 0)
+    fail("read or write of a segment succeeded");
+
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    q = map(fd, size, PROT_READ|PROT_WRITE);
+    strcpy(q + PGSIZE, "from the child");
+    p[3*PGSIZE] = 'x';
+    exit(0);
+  }
+  reap();
+  if(strcmp(p + PGSIZE, "from the child") != 0 || p[3*PGSIZE] != 'x')
+    fail("parent did not see the child's writes");
+
+  // the mapping outlives the descriptor.
+  close(fd);
+  if(statfield("shm:", "segments") != 1)
+    fail("segment freed while still mapped");
+  p[0] = 'y';
+  munmap(p, size);
+  printf("shmtest: anonymous OK\n");
+}
+
+// A named segment, found by name by a child that
+// first closes and unmaps what it inherited.
+void
+named(void)
+{
+  int fd, pid, size = 2*PGSIZE;
+  char *p;
+
+  shmunlink("shmtest");
+  if(shmopen("shmtest", size, O_RDWR) >= 0)
+    fail("opened a segment that does not exist");
+  if((fd = shmopen("shmtest", size, O_CREATE|O_RDWR)) < 0)
+    fail("shmopen with O_CREATE failed");
+  p = map(fd, size, PROT_READ|PROT_WRITE);
+
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    int cfd;
+    char *q;
+
+    close(fd);
+    munmap(p, size);
+    if(shmopen("shmtest", 4*size, O_RDWR) >= 0)
+      fail("opened a segment bigger than it is");
+    if((cfd = shmopen("shmtest", size, O_RDONLY)) < 0)
+      fail("child could not open the segment");
+    if(mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, cfd, 0) != (char*)-1)
+      fail("writable mapping of a read-only descriptor");
+    if(mmap(0, size, PROT_READ, MAP_PRIVATE, cfd, 0) != (char*)-1)
+      fail("private mapping of a segment");
+    q = map(cfd, size, PROT_READ);
+    if(strcmp(q + PGSIZE, "by name") != 0)
+      fail("child did not see the parent's write");
+    exit(0);
+  }
+  strcpy(p + PGSIZE, "by name");
+  reap();
+
+  // unlinked, it goes on for those that have it.
+  if(shmunlink("shmtest") < 0)
+    fail("shmunlink failed");
+  if(shmopen("shmtest", size, O_RDWR) >= 0)
+    fail("opened an unlinked segment");
+  if(strcmp(p + PGSIZE, "by name") != 0)
+    fail("unlinked segment lost its contents");
+  close(fd);
+  munmap(p, size);
+  printf("shmtest: named OK\n");
+}
+
+// Send TOTAL bytes to a child, CHUNK at a time, down a pipe.
+// Returns the ticks taken.
+int
+bypipe(void)
+{
+  int p[2], n, pid, t0;
+
+  if(pipe(p) < 0)
+    fail("pipe failed");
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    close(p[1]);
+    for(n = 0; n < TOTAL; ){
+      int m = read(p[0], chunk, CHUNK);
+      if(m <= 0)
+        fail("short pipe read");
+      n += m;
+    }
+    exit(0);
+  }
+  close(p[0]);
+  for(n = 0; n < TOTAL; n += CHUNK){
+    memset(chunk, n / CHUNK, CHUNK);
+    if(write(p[1], chunk, CHUNK) != CHUNK)
+      fail("pipe write failed");
+  }
+  close(p[1]);
+  reap();
+  return uptime() - t0;
+}
+
+// The same, written in place in a segment; the pipes carry
+// one byte each way per chunk to hand the segment over.
+int
+byshm(void)
+{
+  int go[2], done[2], fd, n, pid, t0;
+  char *seg, c;
+
+  if((fd = shmopen(0, CHUNK, O_RDWR)) < 0)
+    fail("shmopen failed");
+  seg = map(fd, CHUNK, PROT_READ|PROT_WRITE);
+  close(fd);
+  if(pipe(go) < 0 || pipe(done) < 0)
+    fail("pipe failed");
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    close(go[1]);
+    close(done[0]);
+    for(n = 0; n < TOTAL; n += CHUNK){
+      if(read(go[0], &c, 1) != 1)
+        fail("short handshake read");
+      if(seg[0] != (char)(n / CHUNK) || seg[CHUNK-1] != (char)(n / CHUNK))
+        fail("segment holds the wrong chunk");
+      write(done[1], &c, 1);
+    }
+    exit(0);
+  }
+  close(go[0]);
+  close(done[1]);
+  for(n = 0; n < TOTAL; n += CHUNK){
+    memset(seg, n / CHUNK, CHUNK);
+    write(go[1], &c, 1);
+    if(read(done[0], &c, 1) != 1)
+      fail("short handshake read");
+  }
+  close(go[1]);
+  close(done[0]);
+  reap();
+  munmap(seg, CHUNK);
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int tpipe, tshm;
+
+  anon();
+  named();
+  if(statfield("shm:", "segments") != 0 || statfield("shm:", "pages") != 0)
+    fail("segments left after all were closed");
+
+  tpipe = bypipe();
+  tshm = byshm();
+  printf("shmtest: %d KB by pipe in %d ticks, by shared memory in %d ticks\n",
+         TOTAL / 1024, tpipe, tshm);
+  if(statfield("shm:", "segments") != 0)
+    fail("benchmark segment left behind");
+  printf("shmtest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,121 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+// Read a snapshot of the kernel's counters from the
+// statistics device into buf. Returns the number of bytes read.
+// Reads to the end even if buf fills up, so that the next
+// caller starts on a fresh snapshot.
+int
+statistics(void *buf, int sz)
+{
+  int fd, i, n;
+  char junk[64];
+
+  fd = open("statistics", O_RDONLY);
+  if(fd < 0){
+    fprintf(2, "stats: open failed\n");
+    exit(1);
+  }
+  for(i = 0; ; ){
+    if(i < sz)
+      n = read(fd, buf+i, sz-i);
+    else
+      n = read(fd, junk, sizeof(junk));
+    if(n <= 0)
+      break;
+    if(i < sz)
+      i += n;
+  }
+  close(fd);
+  return i;
+}
+
+static char statbuf[8192];
+
+// Sum the numbers following "name " on the lines of
+// the statistics text that start with prefix.
+uint64
+statfield(char *prefix, char *name)
+{
+  int n, plen, nlen;
+  char *p, *q, *s;
+  uint64 tot, v;
+
+  n = statistics(statbuf, sizeof(statbuf)-1);
+  statbuf[n] = 0;
+  plen = strlen(prefix);
+  nlen = strlen(name);
+  tot = 0;
+  for(p = statbuf; *p; p = q){
+    for(q = p; *q && *q != '\n'; q++)
+      ;
+    if(*q)
+      *q++ = 0;
+    if(memcmp(p, prefix, plen) != 0)
+      continue;
+    for(s = p; *s; s++){
+      if((s == p || s[-1] == ' ') && memcmp(s, name, nlen) == 0 && s[nlen] == ' '){
+        // the counters are uint64, too big for atoi().
+        v = 0;
+        for(s += nlen + 1; '0' <= *s && *s <= '9'; s++)
+          v = v*10 + *s - '0';
+        tot += v;
+        break;
+      }
+    }
+  }
+  return tot;
+}
+
+// Print the lines of the statistics text that start with prefix.
+void
+printstat(char *prefix)
+{
+  int n, plen;
+  char *p, *q;
+
+  n = statistics(statbuf, sizeof(statbuf)-1);
+  statbuf[n] = 0;
+  plen = strlen(prefix);
+  for(p = statbuf; *p; p = q){
+    for(q = p; *q && *q != '\n'; q++)
+      ;
+    if(*q)
+      *q++ = 0;
+    if(memcmp(p, prefix, plen) == 0)
+      printf("%s\n", p);
+  }
+}
+
+// Count the lines of the statistics text that
+// start with prefix, such as one per hart.
+int
+statlines(char *prefix)
+{
+  int n, plen, nlines;
+  char *p, *q;
+
+  n = statistics(statbuf, sizeof(statbuf)-1);
+  statbuf[n] = 0;
+  plen = strlen(prefix);
+  nlines = 0;
+  for(p = statbuf; *p; p = q){
+    for(q = p; *q && *q != '\n'; q++)
+      ;
+    if(*q)
+      q++;
+    if(memcmp(p, prefix, plen) == 0)
+      nlines++;
+  }
+  return nlines;
+}
+
+// Free physical pages, wherever the allocator keeps them.
+uint64
+freepages(void)
+{
+  return statfield("kmem cpu", "free") + statfield("buddy:", "free") +
+         statfield("kzero:", "pool") + statfield("kpop:", "unpopulated") / 4;
+}
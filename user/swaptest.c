@@ -0,0 +1,104 @@
+//
+// Test swapping: touch more memory than is free, so that
+// some of it must go out to swap, and check that it all
+// reads back. Then check that a forked child sees the same
+// memory, swapped-out pages included, and that freeing the
+// memory frees the swap slots.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define MAXMB 160     // stay well inside the user address space
+
+// Check that each of the n pages at mem holds its own number,
+// at its start and its end. Returns the ticks taken.
+int
+check(char *who, char *mem, int n)
+{
+  int i, t0;
+
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    uint64 *w = (uint64*)(mem + (uint64)i*PGSIZE);
+    if(w[0] != i || w[PGSIZE/sizeof(uint64) - 1] != ~(uint64)i){
+      printf("swaptest: %s: page %d holds %p\n", who, i, w[0]);
+      exit(1);
+    }
+  }
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 nslot, nfree, out0, in0, used0, used;
+  char *mem;
+  int i, n, t0, twrite, tread, pid, xstatus;
+
+  nslot = statfield("swap:", "slots");
+  if(nslot == 0){
+    printf("swaptest: no swap space\n");
+    exit(1);
+  }
+
+  // more than is free, by half the swap space.
+  nfree = freepages();
+  n = nfree + nslot / 2;
+  if(n > MAXMB * (1024*1024/PGSIZE))
+    n = MAXMB * (1024*1024/PGSIZE);
+  printf("swaptest: %d pages free, %d of swap; using %d\n", (int)nfree, (int)nslot, n);
+
+  used0 = statfield("swap:", "used");
+  out0 = statfield("swap:", "out");
+  in0 = statfield("swap:", "in");
+  mem = sbrk(n * PGSIZE);
+  if(mem == (char*)-1){
+    printf("swaptest: sbrk failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  for(i = 0; i < n; i++){
+    uint64 *w = (uint64*)(mem + (uint64)i*PGSIZE);
+    w[0] = i;
+    w[PGSIZE/sizeof(uint64) - 1] = ~(uint64)i;
+  }
+  twrite = uptime() - t0;
+  tread = check("parent", mem, n);
+  printf("swaptest: write %d ticks, read %d ticks, %d pages out, %d in\n",
+         twrite, tread, (int)(statfield("swap:", "out") - out0),
+         (int)(statfield("swap:", "in") - in0));
+  if(statfield("swap:", "out") == out0){
+    printf("swaptest: nothing was swapped out\n");
+    exit(1);
+  }
+
+  // the child shares the parent's swap slots.
+  pid = fork();
+  if(pid < 0){
+    printf("swaptest: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    check("child", mem, n);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+  check("parent after fork", mem, n);
+
+  // a few pages of other processes, and of this one's
+  // stack, may have gone out too, and stay there.
+  sbrk(-n * PGSIZE);
+  used = statfield("swap:", "used");
+  if(used > used0 + 32){
+    printf("swaptest: %d swap slots still in use\n", (int)used);
+    exit(1);
+  }
+  printf("swaptest: OK\n");
+  exit(0);
+}
@@ -0,0 +1,138 @@
+//
+// Test the shared program text cache: run several copies of
+// sh at once and report the memory they use, then check that
+// writing a program file drops its pages from the cache.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NSH 10
+
+char blk[512];
+
+void
+manysh(void)
+{
+  int in[2], out[2], pid, i;
+  uint64 free0, free1, hit0;
+
+  if(pipe(in) < 0 || pipe(out) < 0){
+    printf("texttest: pipe failed\n");
+    exit(1);
+  }
+  close(out[0]);   // sh's prompts go nowhere
+
+  free0 = freepages();
+  hit0 = statfield("text:", "hit");
+  for(i = 0; i < NSH; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("texttest: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      close(0);
+      dup(in[0]);
+      close(1);
+      dup(out[1]);
+      close(2);
+      dup(out[1]);
+      close(in[0]);
+      close(in[1]);
+      close(out[1]);
+      char *argv[] = { "sh", 0 };
+      exec("sh", argv);
+      exit(1);
+    }
+  }
+  close(in[0]);
+  close(out[1]);
+
+  // let them all start up and block reading commands.
+  sleep(10);
+  free1 = freepages();
+  printf("%d sh: %l pages in use, %l per process, %l text cache hits\n",
+         NSH, free0 - free1, (free0 - free1) / NSH,
+         statfield("text:", "hit") - hit0);
+
+  close(in[1]);
+  for(i = 0; i < NSH; i++)
+    wait(0);
+  printf("after exit: %l pages in use\n", free0 - freepages());
+}
+
+void
+run(char *path)
+{
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("texttest: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    char *argv[] = { path, "x", 0 };
+    close(1);
+    exec(path, argv);
+    exit(2);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("texttest: %s failed\n", path);
+    exit(1);
+  }
+}
+
+void
+invalidate(void)
+{
+  char *tmp = "texttest.tmp";
+  int fd, fd1, n;
+  uint64 inval0;
+
+  // copy echo, run the copy so its text is cached, then
+  // write the first block back unchanged.
+  fd = open("echo", O_RDONLY);
+  fd1 = open(tmp, O_CREATE|O_WRONLY);
+  if(fd < 0 || fd1 < 0){
+    printf("texttest: open failed\n");
+    exit(1);
+  }
+  while((n = read(fd, blk, sizeof(blk))) > 0)
+    write(fd1, blk, n);
+  close(fd);
+  close(fd1);
+
+  run(tmp);
+  inval0 = statfield("text:", "inval");
+  fd = open(tmp, O_RDONLY);
+  read(fd, blk, sizeof(blk));
+  close(fd);
+  fd = open(tmp, O_WRONLY);
+  if(write(fd, blk, sizeof(blk)) != sizeof(blk)){
+    printf("texttest: write failed\n");
+    exit(1);
+  }
+  close(fd);
+  if(statfield("text:", "inval") == inval0){
+    printf("texttest: write did not invalidate cached text\n");
+    exit(1);
+  }
+  run(tmp);
+  unlink(tmp);
+}
+
+int
+main(int argc, char *argv[])
+{
+  manysh();
+  invalidate();
+  printf("texttest: OK\n");
+  exit(0);
+}
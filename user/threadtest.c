@@ -0,0 +1,286 @@
+//
+// Test clone() and join(): threads share memory, including
+// memory one of them grows with sbrk(), and open files; each
+// runs until it exits, and join() reaps them; exec() fails
+// while there are threads; and a main thread's exit() ends
+// them all. Then time a parallel sum over a large array
+// with 1 up to NCPU threads, to see how it scales.
+//
+// The threads in frames() fill enough process slots that, for
+// some k, threads in slots k and 2k take turns on one hart; a
+// thread's trapframe must not be confused with the kernel
+// stack of another whose slot is half its own.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define STACKSZ 4096
+#define NTHREAD 4
+#define NSUM    (1 << 20)   // ints in the array to sum
+#define NPASS   8           // passes over it per thread
+#define NFRAME  24          // threads in frames()
+#define NCHURN  2000        // system calls each makes
+
+int slot[NTHREAD];
+int counter;
+int fds[2];
+char *grown;
+int data[NSUM];
+uint64 sums[NCPU];
+int nsum;
+int churned[NFRAME];
+
+void
+fail(char *s)
+{
+  printf("threadtest: %s\n", s);
+  exit(1);
+}
+
+// Start a thread running fn(arg) on a new stack.
+int
+start(void (*fn)(void*), void *arg)
+{
+  char *stack;
+  int pid;
+
+  if((stack = malloc(STACKSZ)) == 0)
+    fail("malloc failed");
+  if((pid = clone(fn, arg, stack + STACKSZ)) < 0)
+    fail("clone failed");
+  return pid;
+}
+
+// Reap one thread, and free its stack.
+int
+reap(void)
+{
+  void *stack;
+  int pid;
+
+  if((pid = join(&stack)) < 0)
+    fail("join failed");
+  free((char*)stack - STACKSZ);
+  return pid;
+}
+
+void
+bump(void *arg)
+{
+  int i = (int)(uint64)arg;
+
+  slot[i] = i + 100;
+  for(int j = 0; j < 1000; j++)
+    __sync_fetch_and_add(&counter, 1);
+  exit(0);
+}
+
+// Threads see each other's writes, and each
+// join() reaps one of them.
+void
+basic(void)
+{
+  int i, pids[NTHREAD], pid;
+
+  for(i = 0; i < NTHREAD; i++)
+    pids[i] = start(bump, (void*)(uint64)i);
+  for(i = 0; i < NTHREAD; i++){
+    pid = reap();
+    for(int j = 0; j < NTHREAD; j++)
+      if(pids[j] == pid)
+        pids[j] = 0;
+  }
+  for(i = 0; i < NTHREAD; i++){
+    if(pids[i] != 0)
+      fail("join returned the wrong pid");
+    if(slot[i] != i + 100)
+      fail("a thread's write was lost");
+  }
+  if(counter != NTHREAD * 1000)
+    fail("counter is wrong");
+  if(join(0) >= 0)
+    fail("join with no threads succeeded");
+  printf("threadtest: basic OK\n");
+}
+
+void
+grow(void *arg)
+{
+  char *p;
+
+  if((p = sbrk(8192)) == (char*)-1)
+    exit(1);
+  p[0] = 'a';
+  p[8191] = 'b';
+  grown = p;
+  if(pipe(fds) < 0)
+    exit(1);
+  if(write(fds[1], "x", 1) != 1)
+    exit(1);
+  exit(0);
+}
+
+// Memory a thread adds with sbrk(), and files it
+// opens, belong to the whole process.
+void
+shared(void)
+{
+  char c;
+
+  start(grow, 0);
+  reap();
+  if(grown == 0 || grown[0] != 'a' || grown[8191] != 'b')
+    fail("memory grown by a thread is missing");
+  if(read(fds[0], &c, 1) != 1 || c != 'x')
+    fail("pipe opened by a thread is missing");
+  close(fds[0]);
+  close(fds[1]);
+  printf("threadtest: shared OK\n");
+}
+
+void
+waiter(void *arg)
+{
+  char c;
+
+  read(fds[0], &c, 1);
+  exit(0);
+}
+
+void
+spinner(void *arg)
+{
+  for(;;)
+    ;
+}
+
+// exec() fails while there are threads, and
+// the main thread's exit() ends them.
+void
+lifetime(void)
+{
+  char *argv[] = { "echo", "threadtest: exec should have failed", 0 };
+  int pid, xstatus;
+
+  if(pipe(fds) < 0)
+    fail("pipe failed");
+  start(waiter, 0);
+  if(exec("echo", argv) >= 0)
+    fail("exec succeeded");
+  write(fds[1], "x", 1);
+  reap();
+  close(fds[0]);
+  close(fds[1]);
+
+  pid = fork();
+  if(pid < 0)
+    fail("fork failed");
+  if(pid == 0){
+    start(spinner, 0);
+    start(spinner, 0);
+    sleep(1);
+    exit(7);
+  }
+  if(wait(&xstatus) != pid || xstatus != 7)
+    fail("process with threads did not exit");
+  printf("threadtest: lifetime OK\n");
+}
+
+void
+churn(void *arg)
+{
+  int i = (int)(uint64)arg;
+  int pid = getpid();
+  uint64 s = 0;
+
+  for(int j = 0; j < NCHURN; j++){
+    if(getpid() != pid)
+      exit(1);
+    s += j;
+  }
+  if(s == (uint64)NCHURN * (NCHURN - 1) / 2)
+    churned[i] = 1;
+  exit(0);
+}
+
+// Many threads, more than there are harts, entering and
+// leaving the kernel over and over, each through its own
+// trapframe, keep their registers.
+void
+frames(void)
+{
+  int i;
+
+  for(i = 0; i < NFRAME; i++)
+    start(churn, (void*)(uint64)i);
+  for(i = 0; i < NFRAME; i++)
+    reap();
+  for(i = 0; i < NFRAME; i++)
+    if(!churned[i])
+      fail("a thread's registers were lost across a system call");
+  printf("threadtest: frames OK\n");
+}
+
+void
+sum(void *arg)
+{
+  int i = (int)(uint64)arg;
+  int lo = (uint64)NSUM * i / nsum, hi = (uint64)NSUM * (i+1) / nsum;
+  uint64 s = 0;
+
+  for(int pass = 0; pass < NPASS; pass++)
+    for(int j = lo; j < hi; j++)
+      s += data[j];
+  sums[i] = s;
+  exit(0);
+}
+
+// Sum data[] with n threads, and report how long it took.
+void
+parallel(int n, uint64 *t1)
+{
+  uint64 t0, t, s;
+  int i;
+
+  nsum = n;
+  t0 = usecs();
+  for(i = 0; i < n; i++)
+    start(sum, (void*)(uint64)i);
+  for(i = 0; i < n; i++)
+    reap();
+  t = usecs() - t0;
+  if(t == 0)
+    t = 1;
+  if(n == 1)
+    *t1 = t;
+
+  s = 0;
+  for(i = 0; i < n; i++)
+    s += sums[i];
+  if(s != (uint64)NPASS * NSUM * (NSUM - 1) / 2)
+    fail("wrong sum");
+  printf("threadtest: %d threads: %d us, speedup %d.%d\n",
+         n, (int)t, (int)(*t1 / t), (int)(*t1 * 10 / t % 10));
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 t1;
+  int n;
+
+  basic();
+  shared();
+  lifetime();
+  frames();
+
+  for(int i = 0; i < NSUM; i++)
+    data[i] = i;
+  for(n = 1; n <= NCPU; n *= 2)
+    parallel(n, &t1);
+  printf("threadtest: OK\n");
+  exit(0);
+}
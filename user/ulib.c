@@ -1,6 +1,7 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/time.h"
 #include "user/user.h"
 
 char*
@@ -134,3 +135,15 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// Microseconds since boot, or 0 if the clock
+// cannot be read.
+uint64
+usecs(void)
+{
+  struct timespec ts;
+
+  if(clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+    return 0;
+  return ts.sec * 1000000 + ts.nsec / 1000;
+}
@@ -1,5 +1,8 @@
 struct stat;
 struct rtcdate;
+struct spawnact;
+struct timespec;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -23,6 +26,20 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int spawn(char*, char**, struct spawnact*, int);
+int shmopen(char*, int, int);
+int shmunlink(char*);
+int setpriority(int, int);
+int getpriority(int);
+int clock_gettime(int, struct timespec*);
+int nanosleep(struct timespec*);
+int clone(void(*)(void*), void*, void*);
+int join(void**);
+int futex_wait(int*, int);
+int futex_wake(int*, int);
+int lockstat(struct lockstat*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -40,3 +57,27 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+uint64 usecs(void);
+
+// statistics.c
+int statistics(void*, int);
+uint64 statfield(char*, char*);
+int statlines(char*);
+void printstat(char*);
+uint64 freepages(void);
+
+// usync.c
+struct mutex {
+  int state;    // 0 unlocked, 1 locked, 2 locked with waiters
+};
+struct cond {
+  int seq;      // bumped by every signal
+};
+void mutex_init(struct mutex*);
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_init(struct cond*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
@@ -0,0 +1,92 @@
+//
+// Mutexes and condition variables for threads, and for
+// processes sharing memory, built on futex_wait() and
+// futex_wake(). An uncontended lock or unlock is a single
+// atomic instruction; only a thread that must wait, or one
+// that must wake a waiter, makes a system call.
+//
+// The mutex is the one from Drepper's "Futexes Are Tricky":
+// its word is 2 while anyone may be waiting, so mutex_unlock()
+// calls futex_wake() only then.
+//
+
+#include "kernel/param.h"
+#include "kernel/types.h"
+#include "user/user.h"
+
+#define SPINS 100   // tries before sleeping in mutex_lock()
+
+void
+mutex_init(struct mutex *m)
+{
+  m->state = 0;
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+  return __sync_val_compare_and_swap(&m->state, 0, 1) == 0;
+}
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c, i;
+
+  // the holder may be about to let go, on another hart.
+  for(i = 0; i < SPINS; i++){
+    if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+      return;
+    if(c == 2)
+      break;
+  }
+  // mark the lock contended, then sleep until it is free;
+  // having waited, it cannot know that no one else is,
+  // so it takes the lock marked contended.
+  while((c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE)) != 0)
+    futex_wait(&m->state, 2);
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+    futex_wake(&m->state, 1);
+  }
+}
+
+void
+cond_init(struct cond *c)
+{
+  c->seq = 0;
+}
+
+// Release m, wait for a signal, and take m again. As with
+// any condition variable, the caller should check its
+// condition again on return.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+
+  mutex_unlock(m);
+  // a signal after the unlock has changed seq already,
+  // and futex_wait() returns at once.
+  futex_wait(&c->seq, seq);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, NPROC);
+}
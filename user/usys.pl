@@ -36,3 +36,17 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("mmap");
+entry("munmap");
+entry("spawn");
+entry("shmopen");
+entry("shmunlink");
+entry("setpriority");
+entry("getpriority");
+entry("clock_gettime");
+entry("nanosleep");
+entry("clone");
+entry("join");
+entry("futex_wait");
+entry("futex_wake");
+entry("lockstat");